@@ -0,0 +1,73 @@
+#if !defined(ANALYSIS_H)
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "pages.h"
+
+
+/*
+ * Static analysis of a rom, without running it. The code is walked from
+ * ROM_START_ADR through jumps, calls (assumed to return) and both sides of
+ * every skip, then split in basic blocks. Within a block, I is followed
+ * from ANNN so the bytes DXYn / FX65 read become data and the bytes
+ * FX33 / FX55 store to are flagged, code among them is self-modifying.
+ * BNNN targets are only known at run time, the walk stops there.
+ *
+ * Results are cached on disk ($XDG_CACHE_HOME/chip-8, else ~/.cache/chip-8),
+ * one file per rom hash and variant, see analysis_load().
+ */
+
+#define ANALYSIS_CODE       0x01            /* first byte of a reachable instruction */
+#define ANALYSIS_OPERAND    0x02            /* other bytes of a reachable instruction */
+#define ANALYSIS_LEADER     0x04            /* a basic block starts here */
+#define ANALYSIS_CALLED     0x08            /* 2NNN target */
+#define ANALYSIS_DATA       0x10            /* read by DXYn / FX65 / 5XY3 / F002 */
+#define ANALYSIS_WRITTEN    0x20            /* stored to by FX33 / FX55 / 5XY2 */
+#define ANALYSIS_INDIRECT   0x40            /* BNNN */
+
+
+typedef enum {
+    BLOCK_FALLTHROUGH = 0,                  /* into the next leader, targets[0] */
+    BLOCK_JUMP,                             /* 1NNN, targets[0] */
+    BLOCK_CALL,                             /* 2NNN, targets[0] then the return address targets[1] */
+    BLOCK_SKIP,                             /* not taken targets[0], taken targets[1] */
+    BLOCK_RETURN,                           /* 00EE */
+    BLOCK_INDIRECT,                         /* BNNN */
+    BLOCK_HALT,                             /* 1NNN to itself, 00FD */
+    BLOCK_END,                              /* runs off the end of memory */
+} block_exit_t;
+
+typedef struct analysis_block {
+    uint16_t start, end;                    /* [start, end), end follows the last instruction */
+    uint16_t targets[2];
+    uint8_t nb_targets;
+    uint8_t exit;                           /* block_exit_t */
+    uint16_t nb_instructions;
+} analysis_block_t;
+
+typedef struct analysis {
+    uint64_t rom_hash;
+    size_t rom_len;
+    variant_t variant;
+    uint32_t memory_size;                   /* 4 KB, 64 KB for XO-CHIP */
+
+    uint8_t* flags;                         /* ANALYSIS_* per address */
+    analysis_block_t* blocks;               /* by start address */
+    uint32_t nb_blocks;
+
+    int from_cache;
+} analysis_t;
+
+
+analysis_t* analysis_run(const rom_t* rom, variant_t variant);
+analysis_t* analysis_load(const rom_t* rom, variant_t variant);                 /* from the cache, else analysis_run() and store it */
+void analysis_free(analysis_t* analysis);
+
+const analysis_block_t* analysis_block_at(const analysis_t* analysis, uint16_t addr);   /* block starting at addr, NULL if none */
+uint64_t analysis_rom_hash(const rom_t* rom);
+
+
+#endif /* ANALYSIS_H */
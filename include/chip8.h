@@ -2,23 +2,41 @@
 #define CHIP8_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "common.h"
+#include "fusion.h"
 #include "gui.h"
+#include "pages.h"
 
 
 #define DEFAULT_UPDATE_RATE_CHIP8 900
+#define DEFAULT_UPDATE_RATE_SCHIP   1800
+#define DEFAULT_UPDATE_RATE_XOCHIP  60000
 #define UPDATE_RATE_60HZ   60
-
-#define MEMORY_SIZE      4096
-#define ROM_START_ADR   0x200
-#define FONT_START_ADR   0x50
-#define FONT_SIZE      16 * 5               /* 16 * 5 byte characters */
+#define DEFAULT_HEADLESS_FRAMES  3600       /* one minute of emulated time */
 
 #define NB_REGISTER 16
 #define STACK_SIZE  16
+#define STACK_MASK  (STACK_SIZE - 1)
+#define NB_FLAGS    16                      /* SCHIP / XO-CHIP FX75 / FX85 */
+
+#define QUIRK_VF_RESET          0x01        /* 8XY1 / 8XY2 / 8XY3 clear VF */
+#define QUIRK_MEMORY_INCREMENT  0x02        /* FX55 / FX65 advance I */
+#define QUIRK_SHIFT_VY          0x04        /* 8XY6 / 8XYE shift VY into VX */
+#define QUIRK_JUMP_VX           0x08        /* BXNN jumps to XNN + VX */
+#define QUIRK_WRAP              0x10        /* sprites wrap around the edges instead of clipping */
+#define QUIRK_LONG_SKIP         0x20        /* skips jump over the 4 byte F000 NNNN */
 
 
+struct debugger;
+struct trace;
+struct perf;
+struct runahead;
+struct latency;
+struct keyscript;
+struct watchdog;
+
 typedef struct cpu {
     uint8_t V[NB_REGISTER];                 /* general purpose registers */
     uint8_t DT, ST;                         /* delay and sound timer */
@@ -29,27 +47,152 @@ typedef struct cpu {
     uint16_t stack[STACK_SIZE];
 } cpu_t;
 
+typedef struct chip8_ext {                  /* SCHIP / XO-CHIP storage, CHIP-8 instances stay small */
+    page_t* pages[NB_MAX_PAGES];
+    uint64_t display[DISPLAY_MAX_WORDS];
+    uint8_t flags[NB_FLAGS];                /* FX75 / FX85 */
+    uint8_t audio_pattern[16];              /* XO-CHIP F002, no audio output yet */
+    uint8_t pitch;                          /* XO-CHIP FX3A */
+} chip8_ext_t;
+
 typedef struct chip8 {
     int running;
     int ips;
 
     cpu_t cpu;
-    uint8_t memory[MEMORY_SIZE];
-    uint8_t display[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
+    page_t** pages;                         /* shared with the rom until written, see chip8_write() */
+    uint16_t memory_mask;                   /* 4 KB, or 64 KB for XO-CHIP */
+    uint64_t owned_pages[NB_MAX_PAGES / 64];    /* bit set for pages only this instance references */
+    uint64_t written_pages;                 /* bit (page & 63) set by every store, cleared by --watchdog */
+    uint64_t* display;                      /* one bit per pixel, MSB is the leftmost column, see display_mode_t */
+    display_mode_t display_mode;            /* active resolution, changed by 00FE / 00FF */
+    uint8_t planes;                         /* XO-CHIP planes drawn, cleared and scrolled, FN01 */
+    int display_dirty;                      /* set by CLS / DXYn / scrolls / reset, cleared by whoever presents it */
+
+    variant_t variant;
+    uint8_t quirks;
+    timing_t timing;
+    int32_t cycles;                         /* --timing vip budget left in this frame, negative when in debt */
+    chip8_ext_t* ext;                       /* NULL for CHIP-8 */
+    page_t* page_table[NB_PAGES];           /* pages of CHIP-8 / SCHIP instances */
+    uint64_t screen[CHIP8_DISPLAY_HEIGHT];  /* display of CHIP-8 instances */
 
     uint16_t keys_last_state;
     uint16_t keys_current_state;
 
+    uint32_t rng;                           /* xorshift32 state, must never be 0 */
+    rom_t* rom;                             /* memory image restored by chip8_reset() */
+
     gui_t* gui;
+    struct debugger* debugger;              /* DEBUG mode only */
+    struct trace* trace;                    /* --trace only */
+    struct perf* perf;                      /* --perf-counters only */
+    struct runahead* runahead;              /* --run-ahead only */
+    struct latency* latency;                /* --latency only */
+    struct keyscript* keyscript;            /* --input, HEADLESS only */
+    struct watchdog* watchdog;              /* --watchdog, HEADLESS only */
+    struct fusion* fusion;                  /* --fusion or chip8_engine_fused() only */
     int wait_next_frame;
     rendering_mode_t rendering_mode;
+
+    const char* rom_path;
+    int watch_fd;                           /* inotify fd on the rom directory, -1 when not watching */
+    int keep_state;
+
+    uint64_t nb_instructions, nb_frames;
+    int max_frames;                         /* HEADLESS only */
 } chip8_t;
 
+typedef struct chip8_state {               /* see chip8_save_state(), pages stay shared until written */
+    cpu_t cpu;
+    page_t* pages[NB_MAX_PAGES];
+    int nb_pages;
+    uint64_t display[DISPLAY_MAX_WORDS];
+    display_mode_t display_mode;
+    uint8_t planes;
+    uint8_t flags[NB_FLAGS];
 
-chip8_t* chip8_init(const char* rom_path, rendering_mode_t mode, int scale, int show_grid, int ips);
+    uint16_t keys_last_state;
+    uint16_t keys_current_state;
+    uint32_t rng;
+    int wait_next_frame;
+    int32_t cycles;
+    uint64_t nb_frames;
+} chip8_state_t;
+
+typedef int (*chip8_engine_t)(chip8_t* chip8, int budget);     /* runs at most budget instructions, returns how many ran, idle timer waits included */
+
+
+chip8_t* chip8_init(const args_t* args);
 void chip8_quit(chip8_t* chip8);
 
 void chip8_main_loop(chip8_t* chip8);
 
+/* headless core, no frontend is touched when rendering_mode is HEADLESS */
+chip8_t* chip8_create(rom_t* rom);                      /* pool allocated, HEADLESS, takes a reference on rom */
+void chip8_destroy(chip8_t* chip8);
+chip8_t* chip8_fork(chip8_t* parent);                   /* HEADLESS copy sharing every page, both copy on their next write */
+void chip8_set_rom(chip8_t* chip8, rom_t* rom);         /* applied by the next chip8_reset() */
+void chip8_set_variant(chip8_t* chip8, variant_t variant);             /* resets, the rom must fit the variant memory */
+void chip8_reset(chip8_t* chip8);
+size_t chip8_footprint(const chip8_t* chip8);           /* bytes owned by this instance only */
+void chip8_save_state(chip8_t* chip8, chip8_state_t* state);            /* holds page references until chip8_release_state() */
+void chip8_load_state(chip8_t* chip8, const chip8_state_t* state);     /* same variant as the save */
+void chip8_release_state(chip8_state_t* state);
+void chip8_step(chip8_t* chip8);
+void chip8_next_frame(chip8_t* chip8, uint16_t keys);
+void chip8_run_frame(chip8_t* chip8, uint16_t keys);
+
+int chip8_engine_reference(chip8_t* chip8, int budget);
+int chip8_engine_fused(chip8_t* chip8, int budget);       /* allocates chip8->fusion on first use, see fusion.h */
+
+void chip8_own_page(chip8_t* chip8, int index);
+
+
+static inline size_t chip8_display_size(const chip8_t* chip8) {                /* bytes */
+    return DISPLAY_WORDS(chip8->display_mode) * sizeof(uint64_t);
+}
+
+static inline uint64_t chip8_display_hash(const chip8_t* chip8) {              /* FNV-1a over the display words */
+    uint64_t hash = 0xCBF29CE484222325ULL ^ chip8->display_mode.width;
+
+    for (size_t i = 0; i < DISPLAY_WORDS(chip8->display_mode); i++) {
+        hash ^= chip8->display[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static inline int chip8_nb_pages(const chip8_t* chip8) {
+    return (chip8->memory_mask + 1) >> PAGE_SHIFT;
+}
+
+static inline uint8_t chip8_read(const chip8_t* chip8, uint16_t addr) {
+    addr &= chip8->memory_mask;
+    return chip8->pages[addr >> PAGE_SHIFT]->data[addr & PAGE_MASK];
+}
+
+static inline uint16_t chip8_fetch(const chip8_t* chip8, uint16_t addr) {
+    addr &= chip8->memory_mask;
+    if ((addr & PAGE_MASK) != PAGE_MASK) {                                      /* both bytes in the same page */
+        const uint8_t* data = chip8->pages[addr >> PAGE_SHIFT]->data + (addr & PAGE_MASK);
+        return (data[0] << 8) | data[1];
+    }
+    return (chip8_read(chip8, addr) << 8) | chip8_read(chip8, addr + 1);
+}
+
+static inline void chip8_write(chip8_t* chip8, uint16_t addr, uint8_t value) {
+    addr &= chip8->memory_mask;
+    if (!((chip8->owned_pages[addr >> (PAGE_SHIFT + 6)] >> ((addr >> PAGE_SHIFT) & 63)) & 1)) {
+        chip8_own_page(chip8, addr >> PAGE_SHIFT);
+    }
+    chip8->written_pages |= 1ULL << ((addr >> PAGE_SHIFT) & 63);
+    if (chip8->fusion != NULL) {
+        fusion_invalidate(chip8->fusion, addr, chip8->memory_mask);
+    }
+    chip8->pages[addr >> PAGE_SHIFT]->data[addr & PAGE_MASK] = value;
+}
+
 
 #endif /* CHIP8_H */
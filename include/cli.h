@@ -32,9 +32,11 @@ void cli_init();
 void cli_quit();
 
 uint16_t cli_get_keys();
+char cli_get_char();
+uint16_t cli_char_to_keys(char key);
 
 void cli_print_memory(const chip8_t* chip8);
-void cli_print_display(const uint8_t* display);
+void cli_print_display(const uint64_t* display, display_mode_t mode);
 void cli_print_debug_info(chip8_t* chip8);
 
 
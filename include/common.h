@@ -1,14 +1,31 @@
 #if !defined(COMMON_H)
 #define COMMON_H
 
+#include <stddef.h>
+#include <stdint.h>
 
 #define TRUE  1
 #define FALSE 0
 
+#define ARGS_MAX_POINTS  16
+
+#define WATCH_READ   1
+#define WATCH_WRITE  2
+
 #define WIN_DEFAULT_SCALE   10
 #define CHIP8_DISPLAY_WIDTH   64
 #define CHIP8_DISPLAY_HEIGHT  32
 
+#define DISPLAY_MAX_WIDTH   128             /* SCHIP / XO-CHIP high resolution */
+#define DISPLAY_MAX_HEIGHT  64
+#define DISPLAY_MAX_PLANES  2               /* XO-CHIP */
+#define DISPLAY_MAX_WORDS   (DISPLAY_MAX_WIDTH / 64 * DISPLAY_MAX_HEIGHT * DISPLAY_MAX_PLANES)
+
+#define DISPLAY_PIXEL(ROW, X)  (((ROW) >> (CHIP8_DISPLAY_WIDTH - 1 - (X))) & 1)    /* X in 0-63, one uint64_t of a row */
+#define DISPLAY_ROW_WORDS(MODE)     ((MODE).width / 64)
+#define DISPLAY_PLANE_WORDS(MODE)   (DISPLAY_ROW_WORDS(MODE) * (MODE).height)
+#define DISPLAY_WORDS(MODE)         (DISPLAY_PLANE_WORDS(MODE) * (MODE).nb_planes)
+
 #define BIT_CHECK(X, N) ((X) & (1 << (N)))
 #define BIT_SET(X, N)   ((X) |= (1 << (N)))
 #define BIT_CLEAR(X, N) ((X) &= ~(1 << (N)))
@@ -30,17 +47,52 @@ typedef enum {
     GUI = 0,
     CLI,
     DEBUG,
+    HEADLESS,
 } rendering_mode_t;
 
+typedef enum {
+    VARIANT_CHIP8 = 0,
+    VARIANT_SCHIP,                          /* SUPER-CHIP 1.1, modern quirks */
+    VARIANT_XOCHIP,
+} variant_t;
+
+typedef enum {
+    TIMING_FLAT = 0,                        /* every instruction costs 1 / ips */
+    TIMING_VIP,                             /* COSMAC VIP cycle costs, see timing.h */
+} timing_t;
+
+typedef struct display_mode {               /* the display is nb_planes planes of height rows of width / 64 uint64_t */
+    uint8_t width, height;
+    uint8_t nb_planes;
+} display_mode_t;
+
 typedef struct args {
     char* rom_path;
     rendering_mode_t rendering_mode;
+    variant_t variant;
+    timing_t timing;
     int scale, show_grid, ips;
+    int wall;
+    int watch, keep_state;
+    int frames;
+    char* trace_path;
+    int perf_counters;
+    int run_ahead;
+    int latency;
+    char* input_path;
+    int watchdog;
+    int fusion;
+
+    uint16_t breakpoints[ARGS_MAX_POINTS];
+    uint16_t watchpoints[ARGS_MAX_POINTS];
+    int watch_modes[ARGS_MAX_POINTS];
+    int nb_breakpoints, nb_watchpoints;
 } args_t;
 
 
 int get_key(const char key);
 void parse_args(int argc, char* argv [], args_t* args);
+int read_file(const char* path, uint8_t* buffer, size_t max_len, size_t* len);
 
 
 #endif /* COMMON_H */
\ No newline at end of file
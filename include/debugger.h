@@ -0,0 +1,55 @@
+#if !defined(DEBUGGER_H)
+#define DEBUGGER_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+#define DEBUGGER_NO_ADDR     0xFFFF
+#define DEBUGGER_REASON_LEN  32
+
+
+typedef struct debugger {
+    uint8_t breakpoints[MEMORY_MAX_SIZE / 8];   /* one bit per address, 64 KB for XO-CHIP */
+    uint8_t watch_read[MEMORY_MAX_SIZE / 8];
+    uint8_t watch_write[MEMORY_MAX_SIZE / 8];
+    int nb_watchpoints;
+
+    int paused;
+    int stepping;                           /* pause after the next instruction */
+    uint16_t skip_pc;                       /* resume past the breakpoint we stopped on */
+    uint16_t step_over_pc;                  /* pause when the CALL returns here ... */
+    uint8_t step_over_sp;                   /* ... at this stack depth */
+    int run_to_frame;
+
+    char reason[DEBUGGER_REASON_LEN];
+} debugger_t;
+
+
+void debugger_init(debugger_t* debugger, const args_t* args);
+
+void debugger_toggle_breakpoint(debugger_t* debugger, uint16_t addr);
+void debugger_add_watchpoint(debugger_t* debugger, uint16_t addr, int mode);
+
+int debugger_check_slow(debugger_t* debugger, const chip8_t* chip8);
+void debugger_after_step(debugger_t* debugger, const chip8_t* chip8);
+void debugger_on_frame(debugger_t* debugger);
+int debugger_handle_key(debugger_t* debugger, const chip8_t* chip8, char key);
+
+
+static inline int debugger_check(debugger_t* debugger, const chip8_t* chip8) {  /* TRUE when execution must stop before PC */
+    uint16_t pc = chip8->cpu.PC & chip8->memory_mask;
+
+    if (!BIT_CHECK(debugger->breakpoints[pc >> 3], pc & 7) && debugger->nb_watchpoints == 0) {
+        return FALSE;
+    }
+    return debugger_check_slow(debugger, chip8);
+}
+
+static inline int debugger_has_step_action(const debugger_t* debugger) {
+    return debugger->stepping || debugger->step_over_pc != DEBUGGER_NO_ADDR;
+}
+
+
+#endif /* DEBUGGER_H */
@@ -0,0 +1,92 @@
+#if !defined(FUSION_H)
+#define FUSION_H
+
+#include <stdint.h>
+
+#include "pages.h"
+
+
+/*
+ * Superinstructions for the execution engine (--fusion, chip8_engine_fused()).
+ *
+ * The first time an address is executed, the instructions there are matched
+ * against common idioms and the result is kept in a per address table. Later
+ * runs from that address retire the whole sequence in one dispatch, with the
+ * same effects on registers, VF, memory and display as running it one
+ * instruction at a time. A timer wait looping on itself runs every iteration
+ * left in the frame budget at once, DT only changes between frames; they are
+ * counted as idle time, not as instructions retired.
+ *
+ * With --fusion the reachable code found by the static analysis (see
+ * analysis_load(), cached on disk) is matched before the first frame, the
+ * table only fills at run time for code the walk missed (BNNN targets,
+ * generated code) and entries reset since.
+ *
+ * Every store goes through chip8_write(), which resets the entries of the
+ * sequences that could cover the address, pages swapped by chip8_reset() /
+ * chip8_load_state() reset theirs.
+ */
+
+#define FUSION_MAX_BYTES  6                 /* longest sequence, three instructions */
+
+
+struct chip8;
+struct analysis;
+
+
+typedef enum {
+    FUSION_UNKNOWN = 0,                     /* not matched yet, or invalidated */
+    FUSION_NONE,                            /* no idiom starts here */
+    FUSION_SPRITE_AT,                       /* 6XNN 6YNN DXYn */
+    FUSION_SPRITE,                          /* ANNN DXYn */
+    FUSION_TIMER_WAIT,                      /* FX07 3XNN 1NNN */
+    FUSION_INDEXED_LOAD,                    /* FX1E FY65 */
+    FUSION_COUNTER,                         /* 7XNN 3XNN / 4XNN */
+    NB_FUSIONS,
+} fusion_kind_t;
+
+typedef struct fusion_entry {
+    uint8_t kind;                           /* fusion_kind_t */
+    uint8_t length;                         /* instructions, 0 when nothing is fused */
+    uint8_t X, Y;                           /* registers of the leading instructions */
+    uint8_t nn, nn2;                        /* their immediates */
+    uint16_t addr;                          /* ANNN address, 1NNN target */
+    uint16_t last;                          /* opcode ending the sequence */
+} fusion_entry_t;
+
+typedef struct fusion {
+    fusion_entry_t entries[MEMORY_MAX_SIZE];    /* by address */
+    uint32_t nb_used;                       /* entries below it may be matched, bounds fusion_flush() */
+
+    uint64_t sequences[NB_FUSIONS];         /* fused dispatches by kind */
+    uint64_t instructions[NB_FUSIONS];      /* instructions they retired */
+    uint64_t nb_idle;                       /* timer wait iterations skipped at once, idle time */
+    uint64_t nb_seeded;                     /* addresses matched from the static analysis */
+    uint64_t nb_matches;                    /* addresses matched on first execution */
+    uint64_t nb_invalidations;              /* entries reset by stores */
+} fusion_t;
+
+
+fusion_t* fusion_open();
+void fusion_close(fusion_t* fusion);
+
+void fusion_seed(fusion_t* fusion, const struct chip8* chip8, const struct analysis* analysis);     /* matches the reachable code, memory still the rom image */
+void fusion_match(fusion_t* fusion, const struct chip8* chip8, uint16_t pc);   /* fills the entry of pc, first execution there */
+void fusion_invalidate_page(fusion_t* fusion, int index, uint16_t memory_mask);
+void fusion_flush(fusion_t* fusion);
+void fusion_print(const fusion_t* fusion, uint64_t nb_instructions);
+
+
+static inline void fusion_invalidate(fusion_t* fusion, uint16_t addr, uint16_t memory_mask) {  /* store at addr, see chip8_write() */
+    for (int i = 0; i < FUSION_MAX_BYTES; i++) {
+        fusion_entry_t* entry = &fusion->entries[(addr - i) & memory_mask];
+
+        if (entry->kind != FUSION_UNKNOWN) {
+            entry->kind = FUSION_UNKNOWN;
+            fusion->nb_invalidations++;
+        }
+    }
+}
+
+
+#endif /* FUSION_H */
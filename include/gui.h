@@ -12,19 +12,39 @@ typedef struct gui {
     int scale;
     int show_grid;
 
-    uint8_t buffer[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT * 3];
+    uint8_t buffer[DISPLAY_MAX_WIDTH * DISPLAY_MAX_HEIGHT * 3];   /* R8G8B8, the active mode uses the top left corner */
 
     Texture2D texture;
-    Rectangle source, dest;
+    Rectangle source, dest;                 /* source follows the display mode, dest stays the window */
 } gui_t;
 
+typedef struct gui_wall {                   /* every instance is a tile of one atlas texture */
+    int running;
+    int scale;
+    int cols, rows, nb_tiles;
+    int focus;                              /* tile receiving the keyboard, changed by clicking */
+
+    uint8_t* buffer;                        /* atlas, R8G8B8 */
+    int dirty_first, dirty_last;            /* tile rows to upload, first > last when clean */
+
+    Texture2D texture;
+    Rectangle source, dest;
+} gui_wall_t;
+
 
 void gui_init(gui_t* gui, const char* title, int scale, int show_grid);
 void gui_quit();
 
 void gui_poll_events(gui_t* gui, uint16_t* keys_state);
-void gui_set_buffer(gui_t* gui, uint8_t* buffer);
+void gui_set_buffer(gui_t* gui, const uint64_t* display, display_mode_t mode);
 void gui_render(gui_t* gui);
 
+void gui_wall_init(gui_wall_t* wall, const char* title, int nb_tiles, int scale);
+void gui_wall_quit(gui_wall_t* wall);
+
+void gui_wall_poll_events(gui_wall_t* wall, uint16_t* keys_state);
+void gui_wall_set_tile(gui_wall_t* wall, int index, const uint64_t* display);
+void gui_wall_render(gui_wall_t* wall);
+
 
 #endif // GUI_H
@@ -0,0 +1,26 @@
+#if !defined(KEYSCRIPT_H)
+#define KEYSCRIPT_H
+
+#include <stdint.h>
+
+
+/*
+ * Synthetic input for headless runs, one entry per line:
+ *
+ *   <frame> <keys>      keys held from that frame on, as chip-8 key digits
+ *                       ("5", "46"), or "-" for none
+ *
+ * Frames are decimal and increasing, "#" starts a comment.
+ */
+
+typedef struct keyscript keyscript_t;
+
+
+keyscript_t* keyscript_load(const char* path);
+void keyscript_free(keyscript_t* script);
+
+uint16_t keyscript_keys(keyscript_t* script, uint64_t frame);                  /* frames must not go backwards */
+int keyscript_done(const keyscript_t* script);                                  /* TRUE once the keys can no longer change */
+
+
+#endif /* KEYSCRIPT_H */
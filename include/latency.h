@@ -0,0 +1,41 @@
+#if !defined(LATENCY_H)
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+/*
+ * Input latency, per key edge (press or release):
+ *
+ *   consume   edge seen by the frontend -> first EX9E / EXA1 / FX0A that reads the key
+ *   present   edge seen by the frontend -> first presented frame whose display changed
+ *             after the edge was consumed
+ *
+ * With emulated time (headless runs) timestamps come from the frame count and
+ * the instructions executed in the current frame, so results are reproducible.
+ */
+
+typedef enum {
+    LATENCY_CONSUME = 0,
+    LATENCY_PRESENT,
+    LATENCY_NB_KINDS,
+} latency_kind_t;
+
+typedef struct latency latency_t;
+
+
+latency_t* latency_open(int emulated);
+void latency_close(latency_t* latency);
+
+void latency_keys(latency_t* latency, const chip8_t* chip8, uint16_t previous, uint16_t keys);     /* frontend observed a new key state */
+void latency_consume(latency_t* latency, const chip8_t* chip8, uint8_t key);
+void latency_present(latency_t* latency, const chip8_t* chip8, int changed);                     /* once per frame, changed: display differs from the last one */
+
+uint64_t latency_count(const latency_t* latency, latency_kind_t kind);
+double latency_percentile(const latency_t* latency, latency_kind_t kind, double percent);        /* ms */
+void latency_print(const latency_t* latency);
+
+
+#endif /* LATENCY_H */
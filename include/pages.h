@@ -0,0 +1,80 @@
+#if !defined(PAGES_H)
+#define PAGES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "common.h"
+
+
+#define MEMORY_SIZE      4096
+#define MEMORY_MASK     (MEMORY_SIZE - 1)
+#define MEMORY_MAX_SIZE  0x10000            /* XO-CHIP */
+#define ROM_START_ADR   0x200
+#define FONT_START_ADR   0x50
+#define FONT_SIZE      16 * 5               /* 16 * 5 byte characters */
+#define BIG_FONT_START_ADR  0x100           /* SCHIP / XO-CHIP, FX30 */
+#define BIG_FONT_SIZE  16 * 10
+
+#define PAGE_SHIFT  8
+#define PAGE_SIZE   (1 << PAGE_SHIFT)
+#define PAGE_MASK   (PAGE_SIZE - 1)
+#define NB_PAGES    (MEMORY_SIZE >> PAGE_SHIFT)
+#define NB_MAX_PAGES  (MEMORY_MAX_SIZE >> PAGE_SHIFT)
+
+
+/*
+ * Memory is split in pages shared between every instance running the same
+ * rom. A page referenced more than once is read only, the first store to it
+ * makes a private copy (see page_make_private()). The font pages and the zero
+ * page are static and shared by every rom.
+ *
+ * Roms larger than 4 KB are imaged over the whole 64 KB, smaller ones only
+ * hold the first NB_PAGES pages and read as the zero page past them, see
+ * rom_page(). Instances map the first NB_PAGES pages (CHIP-8, SCHIP) or all
+ * of them (XO-CHIP).
+ *
+ * rom_refill() rewrites the pages of a rom in place, for harnesses running
+ * many roms through one instance. Nothing may keep the old content: every
+ * instance mapping the rom is reset before it runs again, and no snapshot
+ * holds its pages.
+ */
+
+typedef struct page {
+    uint32_t refs;                          /* atomic */
+    uint8_t data[PAGE_SIZE];
+} page_t;
+
+typedef struct rom {                        /* read only memory image, holds a reference on each page */
+    uint32_t refs;                          /* atomic */
+    size_t len;
+    int nb_pages;                           /* NB_PAGES, or NB_MAX_PAGES past 4 KB */
+    page_t* pages[NB_MAX_PAGES];            /* only the first nb_pages are set */
+} rom_t;
+
+
+static inline void page_retain(page_t* page) {
+    __atomic_add_fetch(&page->refs, 1, __ATOMIC_RELAXED);
+}
+
+void page_release(page_t* page);
+void page_make_private(page_t** slot);
+
+page_t* page_zero();                                    /* static, every page of a rom past nb_pages */
+page_t* page_big_font();                                /* static, mapped at BIG_FONT_START_ADR by SCHIP / XO-CHIP */
+
+rom_t* rom_create(const uint8_t* data, size_t len);     /* NULL when the rom does not fit in 64 KB */
+rom_t* rom_load(const char* path);                      /* exits on error */
+int rom_refill(rom_t* rom, const uint8_t* data, size_t len);    /* FALSE when the rom does not fit in 64 KB */
+void rom_retain(rom_t* rom);
+void rom_release(rom_t* rom);
+
+size_t pages_used();                                    /* pool pages, static pages excluded */
+
+
+static inline page_t* rom_page(const rom_t* rom, int index) {
+    return index < rom->nb_pages ? rom->pages[index] : page_zero();
+}
+
+
+#endif /* PAGES_H */
@@ -0,0 +1,37 @@
+#if !defined(PERF_H)
+#define PERF_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+
+typedef enum {
+    PERF_OTHER = 0,                         /* loop overhead, rom reload, trace */
+    PERF_CPU,                               /* instructions */
+    PERF_TIMERS,                            /* 60Hz tick */
+    PERF_RENDER,
+    PERF_INPUT,
+    PERF_NB_PHASES,
+} perf_phase_t;
+
+typedef enum {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_NB_COUNTERS,
+} perf_counter_t;
+
+typedef struct perf perf_t;
+
+
+perf_t* perf_open();                        /* NULL, with a warning, when counters are not permitted */
+void perf_close(perf_t* perf);
+
+perf_phase_t perf_phase(perf_t* perf, perf_phase_t phase);     /* counts since the last call go to the previous phase, returns it */
+void perf_print(perf_t* perf, uint64_t nb_instructions, uint64_t nb_frames);
+
+
+#endif /* PERF_H */
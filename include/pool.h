@@ -0,0 +1,31 @@
+#if !defined(POOL_H)
+#define POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+
+#define POOL_INITIALIZER(BLOCK_SIZE, BLOCKS_PER_SLAB) \
+    { .block_size = (BLOCK_SIZE), .blocks_per_slab = (BLOCKS_PER_SLAB), .lock = PTHREAD_MUTEX_INITIALIZER }
+
+
+typedef struct pool {                       /* fixed size blocks carved from large slabs, thread safe */
+    size_t block_size;
+    size_t blocks_per_slab;
+
+    void* free_list;
+    void** slabs;
+    size_t nb_slabs, nb_used;
+
+    pthread_mutex_t lock;
+} pool_t;
+
+
+void* pool_alloc(pool_t* pool);
+void pool_free(pool_t* pool, void* block);
+void pool_destroy(pool_t* pool);
+
+size_t pool_used(pool_t* pool);
+
+
+#endif /* POOL_H */
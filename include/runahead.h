@@ -0,0 +1,30 @@
+#if !defined(RUNAHEAD_H)
+#define RUNAHEAD_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+#define RUNAHEAD_MAX_FRAMES  8
+#define RUNAHEAD_HISTORY     16              /* power of two, more than RUNAHEAD_MAX_FRAMES */
+
+
+typedef struct runahead {
+    int frames;                             /* how far ahead of the core the presented display is */
+    uint64_t display[DISPLAY_MAX_WORDS];    /* last presented */
+    display_mode_t display_mode;
+
+    uint64_t predicted[RUNAHEAD_HISTORY];   /* display hash expected at a frame, indexed by frame */
+    uint64_t predicted_frame[RUNAHEAD_HISTORY];
+
+    double cost, max_cost;                  /* seconds spent saving, running ahead and rolling back */
+    uint64_t nb_checked, nb_confirmed;      /* predictions the core later agreed with */
+} runahead_t;
+
+
+void runahead_init(runahead_t* runahead, int frames);
+int runahead_present(runahead_t* runahead, chip8_t* chip8, int frames);    /* 0 frames presents the core display, TRUE when it changed */
+
+
+#endif /* RUNAHEAD_H */
@@ -0,0 +1,27 @@
+#if !defined(SEARCH_H)
+#define SEARCH_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+/*
+ * Bulk forks and rollouts for tree search planners: fork one parent into
+ * many children with chip8_fork(), then run every child a few frames with
+ * its own keys on the worker threads. Children are ordinary headless
+ * instances sharing the parent pages until they write to them.
+ */
+
+typedef struct search search_t;
+
+
+search_t* search_init(int nb_threads);                  /* 0 = one thread per online core */
+void search_quit(search_t* search);
+
+void search_fork(chip8_t* parent, chip8_t** children, int count, uint32_t seed);   /* seed 0 keeps the parent rng in every child */
+void search_run(search_t* search, chip8_t** instances, int count, const uint16_t* keys, int frames);   /* keys[i * frames + f], NULL for none */
+void search_destroy(chip8_t** instances, int count);
+
+
+#endif /* SEARCH_H */
@@ -0,0 +1,81 @@
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include <stdint.h>
+
+
+/*
+ * chip-8d, many headless sessions in one long running process, driven over
+ * a Unix domain socket.
+ *
+ * Clients send batches: a server_batch_t header then `count` requests, each
+ * a server_request_t followed by `len` payload bytes. The server answers
+ * every batch with one batch of replies in the same order, a
+ * server_reply_t plus payload per request. Integers are in host byte order,
+ * the socket is local.
+ *
+ * Sessions belong to the connection that created them and are destroyed
+ * when it closes, ids start at 1. Requests of a batch run in order, but
+ * consecutive STEP requests are run together on the worker pool, one
+ * session per work item.
+ */
+
+#define SERVER_DEFAULT_PATH  "/tmp/chip-8d.sock"
+#define SERVER_MAX_BATCH     (16 << 20)     /* bytes, larger batches close the connection */
+#define SERVER_ROM_CACHE     64             /* roms kept loaded, sessions of a cached rom share its pages */
+
+#define SERVER_CREATE_VIP    0x80           /* CREATE flags, --timing vip, the low bits are the variant_t */
+
+
+typedef enum {
+    SERVER_OP_CREATE = 1,                   /* payload rom bytes, arg rng seed (0 = default), reply session */
+    SERVER_OP_FORK,                         /* reply a new session, see chip8_fork() */
+    SERVER_OP_DESTROY,
+    SERVER_OP_RESET,                        /* chip8_reset(), drops the queued keys */
+    SERVER_OP_KEYS,                         /* payload one uint16_t key mask per frame, queued, reply value frames queued */
+    SERVER_OP_STEP,                         /* arg frames, each takes the next queued keys or holds the last, reply value frame count */
+    SERVER_OP_HASH,                         /* reply value FNV-1a of the display, see chip8_display_hash() */
+    SERVER_OP_FRAME,                        /* reply payload the packed display, value width | height << 16 */
+} server_op_t;
+
+typedef enum {
+    SERVER_OK = 0,
+    SERVER_ERR_OP,                          /* unknown op or malformed payload */
+    SERVER_ERR_SESSION,                     /* no such session on this connection */
+    SERVER_ERR_ROM,                         /* empty, or too large for the variant */
+} server_status_t;
+
+typedef struct server_batch {
+    uint32_t size;                          /* bytes following this header */
+    uint32_t count;                         /* requests or replies */
+} server_batch_t;
+
+typedef struct server_request {
+    uint8_t op;                             /* server_op_t */
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t session;
+    uint32_t arg;
+    uint32_t len;                           /* payload bytes */
+} server_request_t;
+
+typedef struct server_reply {
+    uint8_t op;                             /* of the request */
+    uint8_t status;                         /* server_status_t */
+    uint16_t reserved;
+    uint32_t session;
+    uint64_t value;
+    uint32_t len;                           /* payload bytes */
+    uint32_t reserved2;
+} server_reply_t;
+
+typedef struct server server_t;
+
+
+server_t* server_init(const char* path, int nb_threads);   /* replaces a stale socket file, 0 threads = one per online core */
+void server_quit(server_t* server);                     /* closes every connection and removes the socket */
+
+void server_main_loop(server_t* server);                /* until SIGINT / SIGTERM */
+
+
+#endif /* SERVER_H */
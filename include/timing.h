@@ -0,0 +1,35 @@
+#if !defined(TIMING_H)
+#define TIMING_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+/*
+ * COSMAC VIP timing model for --timing vip.
+ *
+ * The VIP runs its 1802 at 1.7609 MHz, 8 clocks per machine cycle, so a 60Hz
+ * frame is 3668 machine cycles. The display interrupt and its DMA take about
+ * half of them, the CHIP-8 interpreter gets the rest. Every instruction
+ * costs the interpreter fetch / decode plus its own body, some depend on the
+ * operands (skips taken, BCD digits, registers stored, sprite rows and
+ * alignment). The costs are approximations of the VIP interpreter, close
+ * enough for roms tuned on real hardware to run at their intended speed.
+ *
+ * Frames run as one burst: chip8_next_frame() adds TIMING_VIP_FRAME_CYCLES
+ * to the instance budget, instructions run while it is positive. A cycle
+ * debt (a CLS costs more than a frame) carries over, cycles left when the
+ * rom waits for the display interrupt are lost.
+ */
+
+#define TIMING_VIP_CYCLES_PER_FRAME  3668  /* 1760900 / 8 / 60 */
+#define TIMING_VIP_INTERRUPT_CYCLES  1832  /* display interrupt and DMA */
+#define TIMING_VIP_FRAME_CYCLES      (TIMING_VIP_CYCLES_PER_FRAME - TIMING_VIP_INTERRUPT_CYCLES)
+#define TIMING_VIP_FETCH_CYCLES      68    /* interpreter fetch and dispatch, every instruction */
+
+
+int timing_vip_cycles(const chip8_t* chip8, uint16_t opcode, uint16_t pc);    /* after the instruction ran, pc is where it was fetched */
+
+
+#endif /* TIMING_H */
@@ -0,0 +1,56 @@
+#if !defined(TRACE_H)
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+/*
+ * Binary execution trace.
+ *
+ * File: "C8TR" + version byte, then records. Multi byte values are LEB128
+ * varints unless noted.
+ *
+ * Instruction record, tag bit 7 clear:
+ *   tag, opcode (2 bytes, big endian), then in tag bit order:
+ *   TRACE_PC      PC, when it differs from trace_next_pc() of the previous
+ *                 instruction (taken skips, RET, JP V0)
+ *   TRACE_REGS    mask of changed V registers, then one byte per set bit
+ *   TRACE_I       new I
+ *   TRACE_MEM     address, length byte, bytes written
+ *   TRACE_STACK   SP byte, then the pushed address on CALL
+ *   TRACE_TIMERS  DT, ST bytes written by the instruction
+ *
+ * Frame record, tag TRACE_FRAME: DT, ST bytes after the 60Hz tick.
+ * Keys record, tag TRACE_KEYS: new key state, written when it changes.
+ */
+
+#define TRACE_MAGIC    "C8TR"
+#define TRACE_VERSION  1
+
+#define TRACE_PC       0x01
+#define TRACE_REGS     0x02
+#define TRACE_I        0x04
+#define TRACE_MEM      0x08
+#define TRACE_STACK    0x10
+#define TRACE_TIMERS   0x20
+#define TRACE_FRAME    0x80
+#define TRACE_KEYS     0x81
+
+
+typedef struct trace trace_t;                   /* one per emulation thread, written by a background thread */
+
+
+trace_t* trace_open(const char* path);
+void trace_close(trace_t* trace);
+
+static inline uint16_t trace_next_pc(uint16_t pc, uint16_t opcode) {        /* what the decoder can infer alone */
+    return ((opcode >> 12) == 0x1 || (opcode >> 12) == 0x2) ? opcode & 0x0FFF : (pc + 2) & 0xFFFF;
+}
+
+void trace_instruction(trace_t* trace, const cpu_t* before, const chip8_t* chip8, uint16_t opcode);
+void trace_frame(trace_t* trace, const chip8_t* chip8);
+
+
+#endif /* TRACE_H */
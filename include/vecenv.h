@@ -0,0 +1,51 @@
+#if !defined(VECENV_H)
+#define VECENV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8.h"
+
+
+/*
+ * Batched environments for reinforcement learning: N instances of one rom
+ * stepped one frame at a time with a key mask per instance. Actions,
+ * observations and done flags are contiguous arrays owned by the caller,
+ * observations are written in place, env i at obs + i * vecenv_obs_size().
+ * An environment that ends is reset right away, its done flag is set and
+ * its observation is the first frame of the new episode.
+ */
+
+typedef enum {
+    VECENV_OBS_PACKED = 0,                  /* CHIP8_DISPLAY_HEIGHT uint64_t rows, MSB is the leftmost pixel */
+    VECENV_OBS_BYTES,                       /* one byte per pixel, 0 or 1, row major */
+} vecenv_obs_t;
+
+typedef int (*vecenv_done_fn_t)(const chip8_t* chip8, void* ctx);
+
+typedef struct vecenv_config {
+    int nb_envs;
+    int nb_threads;                         /* 0 = one per online core */
+    vecenv_obs_t obs;
+    uint32_t seed;                          /* rng seed of env 0, the others are derived from it */
+
+    int max_frames;                         /* episode length, 0 = no limit */
+    int done_on_halt;                       /* end when the rom jumps to itself */
+    vecenv_done_fn_t done;                  /* optional, called after every frame */
+    void* done_ctx;
+} vecenv_config_t;
+
+typedef struct vecenv vecenv_t;
+
+
+vecenv_t* vecenv_init(rom_t* rom, const vecenv_config_t* config);
+void vecenv_quit(vecenv_t* env);
+
+size_t vecenv_obs_size(const vecenv_t* env);
+chip8_t* vecenv_get(vecenv_t* env, int index);
+
+void vecenv_reset(vecenv_t* env, void* obs);
+void vecenv_step(vecenv_t* env, const uint16_t* actions, void* obs, uint8_t* dones);
+
+
+#endif /* VECENV_H */
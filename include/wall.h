@@ -0,0 +1,21 @@
+#if !defined(WALL_H)
+#define WALL_H
+
+#include "common.h"
+
+
+/*
+ * Wall mode: N headless instances of one rom in a single window, each shown
+ * as a tile of one atlas texture. Clicking a tile gives it the keyboard.
+ */
+
+typedef struct wall wall_t;
+
+
+wall_t* wall_init(const args_t* args);
+void wall_quit(wall_t* wall);
+
+void wall_main_loop(wall_t* wall);
+
+
+#endif /* WALL_H */
@@ -0,0 +1,46 @@
+#if !defined(WATCHDOG_H)
+#define WATCHDOG_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+
+/*
+ * Stuck rom detection for batch runs (--watchdog, HEADLESS only).
+ *
+ * At every frame boundary the whole machine state is hashed: registers,
+ * timers, stack, keys, rng, display and memory. Memory and display are
+ * hashed incrementally, only the pages stored to since the last check
+ * (chip8_t.written_pages) and the display when it changed are hashed again.
+ * Once the inputs can no longer change, a state seen again means the rom
+ * repeats the same frames forever, with the period found.
+ *
+ * States are remembered for WATCHDOG_WINDOW to 2 * WATCHDOG_WINDOW frames,
+ * longer cycles are not detected.
+ */
+
+#define WATCHDOG_WINDOW  1024               /* frames, power of two */
+
+
+typedef enum {
+    WATCHDOG_RUNNING = 0,
+    WATCHDOG_HALTED,                        /* jumps to itself, 1NNN at NNN or 00FD */
+    WATCHDOG_WAITING_KEY,                   /* blocked in FX0A, no key will come */
+    WATCHDOG_CYCLE,                         /* any other repeating sequence of frames, static included */
+} watchdog_reason_t;
+
+typedef struct watchdog watchdog_t;
+
+
+watchdog_t* watchdog_open();
+void watchdog_close(watchdog_t* watchdog);
+
+watchdog_reason_t watchdog_check(watchdog_t* watchdog, chip8_t* chip8, int display_changed, int inputs_fixed);   /* once per frame, clears written_pages */
+
+watchdog_reason_t watchdog_reason(const watchdog_t* watchdog);
+int watchdog_exit_status(const watchdog_t* watchdog);  /* 0 while running, 2 halted, 3 waiting for a key, 4 other cycle */
+void watchdog_print(const watchdog_t* watchdog);
+
+
+#endif /* WATCHDOG_H */
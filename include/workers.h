@@ -0,0 +1,19 @@
+#if !defined(WORKERS_H)
+#define WORKERS_H
+
+#include <stddef.h>
+
+
+typedef void (*workers_fn_t)(void* ctx, size_t index);
+
+typedef struct workers workers_t;
+
+
+workers_t* workers_init(int nb_threads);                /* 0 = one thread per online core */
+void workers_quit(workers_t* workers);
+
+int workers_count(const workers_t* workers);
+void workers_run(workers_t* workers, workers_fn_t fn, void* ctx, size_t count);
+
+
+#endif /* WORKERS_H */
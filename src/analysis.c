@@ -0,0 +1,437 @@
+#include "analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+#define ANALYSIS_QUEUED         0x80        /* walk only, cleared before returning */
+#define ANALYSIS_CACHE_MAGIC    0x4E413843  /* "C8AN" */
+#define ANALYSIS_CACHE_VERSION  1
+#define ANALYSIS_PATH_LEN       1024
+
+
+typedef struct walk {
+    const rom_t* rom;
+    analysis_t* analysis;
+    uint16_t mask;
+    uint16_t* stack;                        /* leaders still to walk, each queued once */
+    uint32_t nb_stack;
+} walk_t;
+
+typedef struct cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t rom_hash;
+    uint64_t rom_len;
+    uint32_t variant;
+    uint32_t memory_size;
+    uint32_t nb_blocks;
+    uint32_t reserved;
+} cache_header_t;                           /* then memory_size flags, then the blocks */
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void* priv_alloc(size_t size) {
+    void* data = calloc(1, size);
+
+    if (data == NULL) {
+        printf("[ERROR] Cant allocate rom analysis\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return data;
+}
+
+static uint8_t priv_byte(const rom_t* rom, uint16_t addr) {
+    return rom_page(rom, addr >> PAGE_SHIFT)->data[addr & PAGE_MASK];
+}
+
+static uint16_t priv_word(const walk_t* walk, uint16_t addr) {
+    return (priv_byte(walk->rom, addr & walk->mask) << 8) | priv_byte(walk->rom, (addr + 1) & walk->mask);
+}
+
+static int priv_length(const walk_t* walk, uint16_t addr) {                     /* bytes of the instruction at addr */
+    return walk->analysis->variant == VARIANT_XOCHIP && priv_word(walk, addr) == 0xF000 ? 4 : 2;
+}
+
+static void priv_queue(walk_t* walk, uint16_t addr, uint8_t flags) {
+    uint8_t* flag = &walk->analysis->flags[addr & walk->mask];
+
+    *flag |= ANALYSIS_LEADER | flags;
+    if (!(*flag & (ANALYSIS_CODE | ANALYSIS_QUEUED))) {
+        *flag |= ANALYSIS_QUEUED;
+        walk->stack[walk->nb_stack++] = addr & walk->mask;
+    }
+}
+
+static int priv_exit(const walk_t* walk, uint16_t pc, uint16_t opcode, analysis_block_t* block) {  /* TRUE when the instruction ends a block */
+    uint16_t next = (pc + 2) & walk->mask;
+    uint16_t addr = opcode & 0x0FFF;
+    uint8_t kk = opcode & 0xFF;
+
+    block->nb_targets = 0;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00EE) {
+                block->exit = BLOCK_RETURN;
+                return TRUE;
+            }
+            if (opcode == 0x00FD && walk->analysis->variant != VARIANT_CHIP8) {
+                block->exit = BLOCK_HALT;
+                return TRUE;
+            }
+            return FALSE;
+        case 0x1:
+            if (addr == pc) {
+                block->exit = BLOCK_HALT;
+                return TRUE;
+            }
+            block->exit = BLOCK_JUMP;
+            block->targets[block->nb_targets++] = addr;
+            return TRUE;
+        case 0x2:
+            block->exit = BLOCK_CALL;
+            block->targets[block->nb_targets++] = addr;
+            block->targets[block->nb_targets++] = next;
+            return TRUE;
+        case 0x5:
+        case 0x9:
+            if ((opcode & 0xF) != 0) return FALSE;                              /* 5XY2 / 5XY3 */
+            break;
+        case 0x3:
+        case 0x4:
+            break;
+        case 0xB:
+            block->exit = BLOCK_INDIRECT;
+            return TRUE;
+        case 0xE:
+            if (kk != 0x9E && kk != 0xA1) return FALSE;
+            break;
+        default:
+            return FALSE;
+    }
+
+    block->exit = BLOCK_SKIP;                                                   /* XO-CHIP skips the whole F000 NNNN */
+    block->targets[block->nb_targets++] = next;
+    block->targets[block->nb_targets++] = (next + priv_length(walk, next)) & walk->mask;
+    return TRUE;
+}
+
+static void priv_walk(walk_t* walk, uint32_t pc) {                              /* marks the code reachable from a leader, queues the leaders it reaches */
+    uint8_t* flags = walk->analysis->flags;
+    analysis_block_t block;
+
+    for (;;) {
+        uint16_t opcode;
+        int len;
+
+        if (pc >= walk->analysis->memory_size) return;                         /* runs off the end of memory */
+        if (flags[pc] & ANALYSIS_CODE) {                                        /* falls into code already walked */
+            flags[pc] |= ANALYSIS_LEADER;
+            return;
+        }
+        len = priv_length(walk, pc);
+        if ((uint32_t)pc + len > walk->analysis->memory_size) return;
+
+        opcode = priv_word(walk, pc);
+        flags[pc] |= ANALYSIS_CODE;
+        for (int i = 1; i < len; i++) {
+            flags[pc + i] |= ANALYSIS_OPERAND;
+        }
+
+        if (priv_exit(walk, pc, opcode, &block)) {
+            if (block.exit == BLOCK_INDIRECT) {
+                flags[pc] |= ANALYSIS_INDIRECT;
+            }
+            for (int i = 0; i < block.nb_targets; i++) {
+                priv_queue(walk, block.targets[i], block.exit == BLOCK_CALL && i == 0 ? ANALYSIS_CALLED : 0);
+            }
+            return;
+        }
+        pc += len;
+    }
+}
+
+static void priv_mark(walk_t* walk, uint32_t start, uint32_t len, uint8_t flag) {
+    for (uint32_t i = 0; i < len; i++) {
+        walk->analysis->flags[(start + i) & walk->mask] |= flag;
+    }
+}
+
+static void priv_memory_accesses(walk_t* walk, const analysis_block_t* block) {     /* I is only followed within the block */
+    variant_t variant = walk->analysis->variant;
+    int increments = variant != VARIANT_SCHIP;                                  /* QUIRK_MEMORY_INCREMENT, see chip8_set_variant() */
+    int known = FALSE;
+    uint32_t I = 0;
+
+    for (uint16_t pc = block->start; pc != block->end; pc = (pc + priv_length(walk, pc)) & walk->mask) {
+        uint16_t opcode = priv_word(walk, pc);
+        uint8_t X = (opcode >> 8) & 0xF, Y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+        uint8_t range = (X <= Y ? Y - X : X - Y) + 1;
+
+        switch (opcode >> 12) {
+            case 0xA:
+                I = opcode & 0x0FFF;
+                known = TRUE;
+                break;
+            case 0xD:
+                if (known) priv_mark(walk, I, n == 0 && variant != VARIANT_CHIP8 ? 32 : n, ANALYSIS_DATA);
+                break;
+            case 0x5:
+                if (known && variant == VARIANT_XOCHIP && n == 2) priv_mark(walk, I, range, ANALYSIS_WRITTEN);
+                if (known && variant == VARIANT_XOCHIP && n == 3) priv_mark(walk, I, range, ANALYSIS_DATA);
+                break;
+            case 0xF:
+                switch (opcode & 0xFF) {
+                    case 0x00:
+                        if (variant == VARIANT_XOCHIP && X == 0) {
+                            I = priv_word(walk, pc + 2);
+                            known = TRUE;
+                        }
+                        break;
+                    case 0x02:
+                        if (known && variant == VARIANT_XOCHIP) priv_mark(walk, I, 16, ANALYSIS_DATA);
+                        break;
+                    case 0x33:
+                        if (known) priv_mark(walk, I, 3, ANALYSIS_WRITTEN);
+                        break;
+                    case 0x55:
+                    case 0x65:
+                        if (known) priv_mark(walk, I, X + 1, (opcode & 0xFF) == 0x55 ? ANALYSIS_WRITTEN : ANALYSIS_DATA);
+                        if (increments) I += X + 1;
+                        break;
+                    case 0x1E:
+                    case 0x29:
+                    case 0x30:
+                        known = FALSE;
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static uint32_t priv_build_blocks(walk_t* walk, analysis_block_t* blocks) {    /* from every leader to the next exit or leader, returns the count */
+    analysis_t* analysis = walk->analysis;
+    uint32_t nb_blocks = 0;
+
+    for (uint32_t addr = 0; addr < analysis->memory_size; addr++) {
+        analysis_block_t* block = &blocks[nb_blocks];
+        uint16_t pc = addr;
+
+        analysis->flags[addr] &= ~ANALYSIS_QUEUED;
+        if ((analysis->flags[addr] & (ANALYSIS_LEADER | ANALYSIS_CODE)) != (ANALYSIS_LEADER | ANALYSIS_CODE)) continue;
+
+        memset(block, 0, sizeof(analysis_block_t));
+        block->start = pc;
+        for (;;) {
+            uint32_t next = pc + priv_length(walk, pc);
+
+            block->nb_instructions++;
+            if (priv_exit(walk, pc, priv_word(walk, pc), block)) {
+                block->end = next & walk->mask;
+                break;
+            }
+            if (next >= analysis->memory_size || !(analysis->flags[next] & ANALYSIS_CODE)) {
+                block->exit = BLOCK_END;
+                block->end = next & walk->mask;
+                break;
+            }
+            if (analysis->flags[next] & ANALYSIS_LEADER) {
+                block->exit = BLOCK_FALLTHROUGH;
+                block->targets[block->nb_targets++] = next;
+                block->end = next;
+                break;
+            }
+            pc = next;
+        }
+
+        priv_memory_accesses(walk, block);
+        nb_blocks++;
+    }
+
+    return nb_blocks;
+}
+
+static int priv_cache_path(char* path, size_t len, const analysis_t* analysis) {  /* FALSE when there is no cache directory */
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char dir[ANALYSIS_PATH_LEN];
+
+    if (xdg != NULL && xdg[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/chip-8", xdg);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/chip-8", home);
+    } else {
+        return FALSE;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return FALSE;
+
+    return snprintf(path, len, "%s/%016llx-%d.blocks", dir, (unsigned long long)analysis->rom_hash, analysis->variant) < (int)len;
+}
+
+static analysis_t* priv_cache_read(const char* path, const analysis_t* expected) {     /* NULL unless it matches the rom */
+    cache_header_t header;
+    analysis_t* analysis;
+    FILE* file = fopen(path, "rb");
+    int valid;
+
+    if (file == NULL) return NULL;
+
+    valid = fread(&header, sizeof(header), 1, file) == 1
+         && header.magic == ANALYSIS_CACHE_MAGIC && header.version == ANALYSIS_CACHE_VERSION
+         && header.rom_hash == expected->rom_hash && header.rom_len == expected->rom_len
+         && header.variant == (uint32_t)expected->variant && header.memory_size == expected->memory_size
+         && header.nb_blocks <= expected->memory_size / 2;
+    if (!valid) {
+        fclose(file);
+        return NULL;
+    }
+
+    analysis = priv_alloc(sizeof(analysis_t));
+    *analysis = *expected;
+    analysis->flags = priv_alloc(header.memory_size);
+    analysis->blocks = priv_alloc((header.nb_blocks + 1) * sizeof(analysis_block_t));
+    analysis->nb_blocks = header.nb_blocks;
+    analysis->from_cache = TRUE;
+
+    valid = fread(analysis->flags, header.memory_size, 1, file) == 1
+         && (header.nb_blocks == 0 || fread(analysis->blocks, sizeof(analysis_block_t), header.nb_blocks, file) == header.nb_blocks);
+    fclose(file);
+    if (!valid) {
+        analysis_free(analysis);
+        return NULL;
+    }
+
+    return analysis;
+}
+
+static void priv_cache_write(const char* path, const analysis_t* analysis) {   /* best effort, through a rename so readers never see half a file */
+    cache_header_t header = {
+        .magic = ANALYSIS_CACHE_MAGIC, .version = ANALYSIS_CACHE_VERSION,
+        .rom_hash = analysis->rom_hash, .rom_len = analysis->rom_len,
+        .variant = analysis->variant, .memory_size = analysis->memory_size, .nb_blocks = analysis->nb_blocks,
+    };
+    char tmp_path[ANALYSIS_PATH_LEN + 16];
+    FILE* file;
+    int valid;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    file = fopen(tmp_path, "wb");
+    if (file == NULL) return;
+
+    valid = fwrite(&header, sizeof(header), 1, file) == 1
+         && fwrite(analysis->flags, analysis->memory_size, 1, file) == 1
+         && (analysis->nb_blocks == 0 || fwrite(analysis->blocks, sizeof(analysis_block_t), analysis->nb_blocks, file) == analysis->nb_blocks);
+    valid = fclose(file) == 0 && valid;
+
+    if (!valid || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+analysis_t* analysis_run(const rom_t* rom, variant_t variant) {
+    analysis_block_t *blocks, *shrunk;
+    analysis_t* analysis;
+    walk_t walk;
+
+    analysis = priv_alloc(sizeof(analysis_t));
+    analysis->rom_hash = analysis_rom_hash(rom);
+    analysis->rom_len = rom->len;
+    analysis->variant = variant;
+    analysis->memory_size = variant == VARIANT_XOCHIP ? MEMORY_MAX_SIZE : MEMORY_SIZE;
+    analysis->flags = priv_alloc(analysis->memory_size);
+
+    walk.rom = rom;
+    walk.analysis = analysis;
+    walk.mask = analysis->memory_size - 1;
+    walk.stack = priv_alloc(analysis->memory_size * sizeof(uint16_t));
+    walk.nb_stack = 0;
+
+    priv_queue(&walk, ROM_START_ADR, 0);
+    while (walk.nb_stack > 0) {
+        priv_walk(&walk, walk.stack[--walk.nb_stack]);
+    }
+    blocks = priv_alloc((analysis->memory_size / 2 + 1) * sizeof(analysis_block_t));   /* at most one per instruction */
+    analysis->nb_blocks = priv_build_blocks(&walk, blocks);
+    shrunk = realloc(blocks, (analysis->nb_blocks + 1) * sizeof(analysis_block_t));
+    analysis->blocks = shrunk != NULL ? shrunk : blocks;
+
+    free(walk.stack);
+
+    return analysis;
+}
+
+analysis_t* analysis_load(const rom_t* rom, variant_t variant) {
+    analysis_t expected = { .rom_hash = analysis_rom_hash(rom), .rom_len = rom->len, .variant = variant };
+    char path[ANALYSIS_PATH_LEN];
+    analysis_t* analysis = NULL;
+    int cached;
+
+    expected.memory_size = variant == VARIANT_XOCHIP ? MEMORY_MAX_SIZE : MEMORY_SIZE;
+    cached = priv_cache_path(path, sizeof(path), &expected);
+
+    if (cached) {
+        analysis = priv_cache_read(path, &expected);
+    }
+    if (analysis == NULL) {
+        analysis = analysis_run(rom, variant);
+        if (cached) {
+            priv_cache_write(path, analysis);
+        }
+    }
+
+    return analysis;
+}
+
+void analysis_free(analysis_t* analysis) {
+    free(analysis->flags);
+    free(analysis->blocks);
+    free(analysis);
+}
+
+const analysis_block_t* analysis_block_at(const analysis_t* analysis, uint16_t addr) {
+    uint32_t low = 0, high = analysis->nb_blocks;
+
+    while (low < high) {                                                        /* blocks are sorted by start */
+        uint32_t mid = (low + high) / 2;
+
+        if (analysis->blocks[mid].start < addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low < analysis->nb_blocks && analysis->blocks[low].start == addr ? &analysis->blocks[low] : NULL;
+}
+
+uint64_t analysis_rom_hash(const rom_t* rom) {                                 /* FNV-1a over the rom bytes */
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < rom->len; i++) {
+        hash ^= priv_byte(rom, ROM_START_ADR + i);
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
@@ -1,85 +1,115 @@
 #include "chip8.h"
 
+#include "analysis.h"
 #include "cli.h"
+#include "debugger.h"
+#include "keyscript.h"
+#include "latency.h"
+#include "perf.h"
+#include "pool.h"
+#include "runahead.h"
+#include "timing.h"
+#include "trace.h"
+#include "watchdog.h"
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/inotify.h>
 
 
-static const uint8_t font[FONT_SIZE] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0,       /* 0 */
-    0x20, 0x60, 0x20, 0x20, 0x70,       /* 1 */
-    0xF0, 0x10, 0xF0, 0x80, 0xF0,       /* 2 */
-    0xF0, 0x10, 0xF0, 0x10, 0xF0,       /* 3 */
-    0x90, 0x90, 0xF0, 0x10, 0x10,       /* 4 */
-    0xF0, 0x80, 0xF0, 0x10, 0xF0,       /* 5 */
-    0xF0, 0x80, 0xF0, 0x90, 0xF0,       /* 6 */
-    0xF0, 0x10, 0x20, 0x40, 0x40,       /* 7 */
-    0xF0, 0x90, 0xF0, 0x90, 0xF0,       /* 8 */
-    0xF0, 0x90, 0xF0, 0x10, 0xF0,       /* 9 */
-    0xF0, 0x90, 0xF0, 0x90, 0x90,       /* A */
-    0xE0, 0x90, 0xE0, 0x90, 0xE0,       /* B */
-    0xF0, 0x80, 0x80, 0x80, 0xF0,       /* C */
-    0xE0, 0x90, 0x90, 0x90, 0xE0,       /* D */
-    0xF0, 0x80, 0xF0, 0x80, 0xF0,       /* E */
-    0xF0, 0x80, 0xF0, 0x80, 0x80        /* F */
-};
+#define DEFAULT_RNG_SEED  0x2545F491
+#define INSTANCES_PER_SLAB  1024
+
+
+static pool_t instance_pool = POOL_INITIALIZER(sizeof(chip8_t), INSTANCES_PER_SLAB);
 
 
 /******************************************************
  *                 Private functions                  *
  ******************************************************/
 
-static void priv_render(chip8_t* chip8);
+static void priv_present(chip8_t* chip8);
 
 
-static void priv_load_rom(chip8_t* chip8, const char* path) {
-    FILE* file;
-    uint8_t* buffer;
-    size_t file_len;
+static int priv_watch_rom(const char* path) {                                  /* watch the directory, editors often replace the file */
+    char dir[PATH_MAX];
+    char* slash;
+    int fd;
 
-    file = fopen(path, "rb");                                               /* open file */
-    if (file == NULL) {
-        printf("[ERROR] Cant open rom file: %s\n", path);
-        exit(EXIT_FAILURE);
+    strncpy(dir, path, PATH_MAX - 1);
+    dir[PATH_MAX - 1] = '\0';
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        slash[slash == dir] = '\0';                                             /* keep "/" for roms at the root */
     }
 
-    if (fseek(file, 0, SEEK_END) != 0) {                                    /* go to end of file */
-        printf("[ERROR] fseek failed\n");
-        fclose(file);
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("[ERROR] Cant watch rom directory: %s\n", dir);
         exit(EXIT_FAILURE);
     }
 
-    file_len = ftell(file);                                                 /* len = delta between start - end */
-    if (file_len > MEMORY_SIZE - ROM_START_ADR) {
-        printf("[ERROR] rom to large\n");
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
+    return fd;
+}
 
-    fseek(file, 0, SEEK_SET);                                               /* go back to start */
+static int priv_rom_changed(chip8_t* chip8) {                                    /* drain pending events, non blocking */
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const char* name = strrchr(chip8->rom_path, '/');
+    int changed = FALSE;
+    ssize_t len;
 
-    buffer = malloc(file_len * sizeof(uint8_t));
-    if (buffer == NULL) {
-        printf("[ERROR] Cant allocate rom memory\n");
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
+    name = name == NULL ? chip8->rom_path : name + 1;
 
-    if (fread(buffer, sizeof(uint8_t), file_len, file) != file_len) {   /* read entire file */
-        printf("[ERROR] fread failed for file: %s\n", path);
-        fclose(file);
-        exit(EXIT_FAILURE);
+    while ((len = read(chip8->watch_fd, events, sizeof(events))) > 0) {
+        for (char* ptr = events; ptr < events + len; ) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+
+            if (event->len > 0 && strcmp(event->name, name) == 0) {
+                changed = TRUE;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
     }
 
-    memcpy(chip8->memory + ROM_START_ADR, buffer, file_len);
+    return changed;
+}
+
+static void priv_reload_rom(chip8_t* chip8) {                                    /* reset in place, frontends stay alive */
+    static uint8_t buffer[MEMORY_MAX_SIZE - ROM_START_ADR];
+    uint64_t display[DISPLAY_MAX_WORDS];
+    display_mode_t mode;
+    cpu_t cpu;
+    rom_t* rom;
+    size_t len;
+
+    if (!read_file(chip8->rom_path, buffer, chip8->memory_mask + 1 - ROM_START_ADR, &len)) return;     /* half written or too large, keep the old one */
+
+    cpu = chip8->cpu;
+    mode = chip8->display_mode;
+    memcpy(display, chip8->display, chip8_display_size(chip8));
+
+    rom = rom_create(buffer, len);
+    chip8_set_rom(chip8, rom);
+    rom_release(rom);
+    chip8_reset(chip8);
+
+    if (chip8->keep_state) {
+        chip8->cpu = cpu;
+        chip8->display_mode = mode;
+        memcpy(chip8->display, display, chip8_display_size(chip8));
+    }
+}
 
-    fclose(file);                                                           /* close file */
-    free(buffer);
+static inline perf_phase_t priv_phase(chip8_t* chip8, perf_phase_t phase) {   /* no-op without --perf-counters */
+    return chip8->perf != NULL ? perf_phase(chip8->perf, phase) : phase;
 }
 
 static void priv_signal_callback_handler() {
@@ -98,6 +128,71 @@ static void priv_update_timers(chip8_t* chip8) {
     }
 }
 
+static uint8_t priv_rand(chip8_t* chip8) {                                     /* xorshift32, per instance so runs are reproducible */
+    uint32_t x = chip8->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+
+    return x & 0xFF;
+}
+
+static void priv_frame_update(chip8_t* chip8) {                                 /* 60Hz tick, rom reload, input, present */
+    uint16_t previous_keys;
+
+    priv_phase(chip8, PERF_TIMERS);
+    if (chip8->debugger == NULL || !chip8->debugger->paused) {                  /* paused: frozen timers, keep polling */
+        chip8_next_frame(chip8, chip8->keys_current_state);
+    }
+
+    priv_phase(chip8, PERF_OTHER);
+    if (chip8->watch_fd >= 0 && priv_rom_changed(chip8)) {
+        priv_reload_rom(chip8);
+    }
+
+    priv_phase(chip8, PERF_INPUT);
+    previous_keys = chip8->keys_current_state;
+    switch (chip8->rendering_mode) {
+        case GUI:
+            gui_poll_events(chip8->gui, &chip8->keys_current_state);
+
+            if (chip8->gui->running == FALSE) {
+                chip8->running = FALSE;
+            }
+            break;
+        case CLI:
+            chip8->keys_current_state = cli_get_keys();
+            break;
+        case DEBUG: {
+            char key = cli_get_char();
+
+            debugger_on_frame(chip8->debugger);
+            if (!debugger_handle_key(chip8->debugger, chip8, key)) {
+                chip8->keys_current_state = cli_char_to_keys(key);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (chip8->latency != NULL) {
+        latency_keys(chip8->latency, chip8, previous_keys, chip8->keys_current_state);
+    }
+
+    priv_present(chip8);
+    if (chip8->rendering_mode == DEBUG) {
+        priv_phase(chip8, PERF_RENDER);
+        cli_print_debug_info(chip8);
+    }
+
+    priv_phase(chip8, PERF_OTHER);
+    if (chip8->trace != NULL) {                                                 /* after polling, keys are the ones the next frame sees */
+        trace_frame(chip8->trace, chip8);
+    }
+}
+
 static void priv_delayed_update(chip8_t* chip8, struct timespec* last_update_time, const double target_fps) {
     struct timespec current_time;
     double elapsed_time;
@@ -109,35 +204,144 @@ static void priv_delayed_update(chip8_t* chip8, struct timespec* last_update_tim
     if (elapsed_time < 1.0 / target_fps) return;
 
     *last_update_time = current_time;
+    priv_frame_update(chip8);
+}
 
-    priv_update_timers(chip8);
+static void priv_clear_planes(chip8_t* chip8, uint8_t planes) {
+    size_t words = DISPLAY_PLANE_WORDS(chip8->display_mode);
 
-    chip8->wait_next_frame = FALSE;
-    chip8->keys_last_state = chip8->keys_current_state;
+    for (int p = 0; p < chip8->display_mode.nb_planes; p++) {
+        if (BIT_CHECK(planes, p)) {
+            memset(chip8->display + p * words, 0, words * sizeof(uint64_t));
+        }
+    }
+    chip8->display_dirty = TRUE;
+}
 
-    switch (chip8->rendering_mode) {
-        case GUI:
-            gui_poll_events(chip8->gui, &chip8->keys_current_state);
-            priv_render(chip8);
+static void priv_set_resolution(chip8_t* chip8, int hires) {                    /* 00FE / 00FF, clears every plane */
+    chip8->display_mode.width = hires ? DISPLAY_MAX_WIDTH : CHIP8_DISPLAY_WIDTH;
+    chip8->display_mode.height = hires ? DISPLAY_MAX_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    priv_clear_planes(chip8, 0xFF);
+}
 
-            if (chip8->gui->running == FALSE) {
-                chip8->running = FALSE;
+static void priv_scroll_vertical(chip8_t* chip8, int n) {                      /* down when n > 0, whole rows are moved */
+    display_mode_t mode = chip8->display_mode;
+    size_t words = DISPLAY_ROW_WORDS(mode);
+    size_t rows = n > 0 ? n : -n;
+
+    if (rows > mode.height) rows = mode.height;
+
+    for (int p = 0; p < mode.nb_planes; p++) {
+        uint64_t* plane = chip8->display + p * DISPLAY_PLANE_WORDS(mode);
+
+        if (!BIT_CHECK(chip8->planes, p)) continue;
+
+        if (n > 0) {
+            memmove(plane + rows * words, plane, (mode.height - rows) * words * sizeof(uint64_t));
+            memset(plane, 0, rows * words * sizeof(uint64_t));
+        } else {
+            memmove(plane, plane + rows * words, (mode.height - rows) * words * sizeof(uint64_t));
+            memset(plane + (mode.height - rows) * words, 0, rows * words * sizeof(uint64_t));
+        }
+    }
+    chip8->display_dirty = TRUE;
+}
+
+static void priv_scroll_horizontal(chip8_t* chip8, int n) {                    /* right when n > 0, 0 < |n| < 64 */
+    display_mode_t mode = chip8->display_mode;
+    int shift = n > 0 ? n : -n;
+
+    for (int p = 0; p < mode.nb_planes; p++) {
+        uint64_t* row = chip8->display + p * DISPLAY_PLANE_WORDS(mode);
+
+        if (!BIT_CHECK(chip8->planes, p)) continue;
+
+        for (int y = 0; y < mode.height; y++, row += DISPLAY_ROW_WORDS(mode)) {
+            if (DISPLAY_ROW_WORDS(mode) == 1) {
+                row[0] = n > 0 ? row[0] >> shift : row[0] << shift;
+            } else if (n > 0) {
+                row[1] = (row[1] >> shift) | (row[0] << (64 - shift));
+                row[0] >>= shift;
+            } else {
+                row[0] = (row[0] << shift) | (row[1] >> (64 - shift));
+                row[1] <<= shift;
+            }
+        }
+    }
+    chip8->display_dirty = TRUE;
+}
+
+static inline void priv_skip(chip8_t* chip8) {                                  /* XO-CHIP skips the whole F000 NNNN */
+    cpu_t* cpu = &chip8->cpu;
+
+    if ((chip8->quirks & QUIRK_LONG_SKIP) && chip8_fetch(chip8, cpu->PC) == 0xF000) {
+        cpu->PC += 2;
+    }
+    cpu->PC += 2;
+}
+
+static void priv_00nn(chip8_t* chip8, uint16_t opcode) {                       /* SCHIP / XO-CHIP */
+    switch (opcode & 0xFFF0) {
+        case 0x00C0:                                                            /* SCD n */
+            priv_scroll_vertical(chip8, opcode & 0xF);
+            return;
+        case 0x00D0:                                                            /* SCU n, XO-CHIP */
+            if (chip8->variant == VARIANT_XOCHIP) {
+                priv_scroll_vertical(chip8, -(opcode & 0xF));
             }
+            return;
+        default:
             break;
-        case CLI:
-            chip8->keys_current_state = cli_get_keys();
+    }
+
+    switch (opcode) {
+        case 0x00FB:                                                            /* SCR */
+            priv_scroll_horizontal(chip8, 4);
             break;
-        case DEBUG:
-            chip8->keys_current_state = cli_get_keys();
-            cli_print_debug_info(chip8);
+        case 0x00FC:                                                            /* SCL */
+            priv_scroll_horizontal(chip8, -4);
+            break;
+        case 0x00FD:                                                            /* EXIT, halts on itself */
+            chip8->cpu.PC -= 2;
+            break;
+        case 0x00FE:                                                            /* LOW */
+            priv_set_resolution(chip8, FALSE);
+            break;
+        case 0x00FF:                                                            /* HIGH */
+            priv_set_resolution(chip8, TRUE);
             break;
         default:
             break;
     }
 }
 
-static void priv_clear_display(uint8_t* display) {
-    memset(display, 0, CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT);
+static void priv_5XYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
+    cpu_t* cpu = &chip8->cpu;
+    int step = X <= Y ? 1 : -1;
+
+    switch (n) {
+        case 0x0:                                                               /* SE Vx, Vy */
+            if (cpu->V[X] == cpu->V[Y]) {
+                priv_skip(chip8);
+            }
+            break;
+        case 0x2:                                                               /* LD [I], Vx - Vy, XO-CHIP, I unchanged */
+            if (chip8->variant != VARIANT_XOCHIP) break;
+            for (int i = 0, r = X; ; i++, r += step) {
+                chip8_write(chip8, cpu->I + i, cpu->V[r]);
+                if (r == Y) break;
+            }
+            break;
+        case 0x3:                                                               /* LD Vx - Vy, [I], XO-CHIP, I unchanged */
+            if (chip8->variant != VARIANT_XOCHIP) break;
+            for (int i = 0, r = X; ; i++, r += step) {
+                cpu->V[r] = chip8_read(chip8, cpu->I + i);
+                if (r == Y) break;
+            }
+            break;
+        default:
+            break;
+    }
 }
 
 static void priv_8XYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
@@ -150,15 +354,21 @@ static void priv_8XYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
             break;
         case 0x1:                                                               /* OR Vx, Vy */
             cpu->V[X] |= cpu->V[Y];
-            cpu->V[0xF] = 0;
+            if (chip8->quirks & QUIRK_VF_RESET) {
+                cpu->V[0xF] = 0;
+            }
             break;
         case 0x2:                                                               /* AND Vx, Vy */
             cpu->V[X] &= cpu->V[Y];
-            cpu->V[0xF] = 0;
+            if (chip8->quirks & QUIRK_VF_RESET) {
+                cpu->V[0xF] = 0;
+            }
             break;
         case 0x3:                                                               /* XOR Vx, Vy */
             cpu->V[X] ^= cpu->V[Y];
-            cpu->V[0xF] = 0;
+            if (chip8->quirks & QUIRK_VF_RESET) {
+                cpu->V[0xF] = 0;
+            }
             break;
         case 0x4: {                                                               /* ADD Vx, Vy */
             uint16_t res = cpu->V[X] + cpu->V[Y];
@@ -172,7 +382,9 @@ static void priv_8XYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
             cpu->V[0xF] = flag;
             break;
         case 0x6:                                                               /* SHR Vx {, Vy} */
-            cpu->V[X] = cpu->V[Y];
+            if (chip8->quirks & QUIRK_SHIFT_VY) {
+                cpu->V[X] = cpu->V[Y];
+            }
             flag = cpu->V[X] & 0x01;
             cpu->V[X] >>= 1;
             cpu->V[0xF] = flag;
@@ -183,7 +395,9 @@ static void priv_8XYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
             cpu->V[0xF] = flag;
             break;
         case 0xE:                                                               /* SHL Vx {, Vy} */
-            cpu->V[X] = cpu->V[Y];
+            if (chip8->quirks & QUIRK_SHIFT_VY) {
+                cpu->V[X] = cpu->V[Y];
+            }
             flag = (cpu->V[X] >> 7) & 0x01;
             cpu->V[X] <<= 1;
             cpu->V[0xF] = flag;
@@ -199,12 +413,18 @@ static void priv_Exnn(chip8_t* chip8, uint8_t X, uint8_t nn) {
     switch (nn) {
         case 0x9E:                                                              /* SKP Vx */
             if (BIT_CHECK(chip8->keys_current_state, cpu->V[X] & 0xF)) {
-                cpu->PC += 2;
+                priv_skip(chip8);
+            }
+            if (chip8->latency != NULL) {
+                latency_consume(chip8->latency, chip8, cpu->V[X]);
             }
             break;
         case 0xA1:                                                              /* SKNP Vx */
             if (!BIT_CHECK(chip8->keys_current_state, cpu->V[X] & 0xF)) {
-                cpu->PC += 2;
+                priv_skip(chip8);
+            }
+            if (chip8->latency != NULL) {
+                latency_consume(chip8->latency, chip8, cpu->V[X]);
             }
             break;
         default:
@@ -216,6 +436,24 @@ static void priv_FXnn(chip8_t* chip8, uint8_t X, uint8_t nn) {
     cpu_t* cpu = &chip8->cpu;
 
     switch (nn) {
+        case 0x00:                                                              /* LD I, NNNN, XO-CHIP, F000 NNNN */
+            if (chip8->variant == VARIANT_XOCHIP && X == 0) {
+                cpu->I = chip8_fetch(chip8, cpu->PC);
+                cpu->PC += 2;
+            }
+            break;
+        case 0x01:                                                              /* PLANE n, XO-CHIP, FN01 */
+            if (chip8->variant == VARIANT_XOCHIP) {
+                chip8->planes = X & 0x3;
+            }
+            break;
+        case 0x02:                                                              /* AUDIO, XO-CHIP, F002 */
+            if (chip8->variant == VARIANT_XOCHIP && X == 0) {
+                for (int i = 0; i < 16; i++) {
+                    chip8->ext->audio_pattern[i] = chip8_read(chip8, cpu->I + i);
+                }
+            }
+            break;
         case 0x07:                                                              /* LD Vx, DT */
             cpu->V[X] = cpu->DT;
             break;
@@ -223,6 +461,9 @@ static void priv_FXnn(chip8_t* chip8, uint8_t X, uint8_t nn) {
             for (size_t i = 0; i <= 0xF; i++) {
                 if (!BIT_CHECK(chip8->keys_current_state, i) && BIT_CHECK(chip8->keys_last_state, i)) {
                     cpu->V[X] = i;
+                    if (chip8->latency != NULL) {
+                        latency_consume(chip8->latency, chip8, i);
+                    }
                     return;
                 }
             }
@@ -240,19 +481,45 @@ static void priv_FXnn(chip8_t* chip8, uint8_t X, uint8_t nn) {
         case 0x29:                                                              /* LD F, Vx */
             cpu->I = FONT_START_ADR + (cpu->V[X] & 0xF) * 5;
             break;
+        case 0x30:                                                              /* LD HF, Vx, SCHIP */
+            if (chip8->ext != NULL) {
+                cpu->I = BIG_FONT_START_ADR + (cpu->V[X] & 0xF) * 10;
+            }
+            break;
+        case 0x3A:                                                              /* PITCH Vx, XO-CHIP */
+            if (chip8->variant == VARIANT_XOCHIP) {
+                chip8->ext->pitch = cpu->V[X];
+            }
+            break;
         case 0x33:                                                              /* LD B, Vx */
-            chip8->memory[cpu->I + 0] = cpu->V[X] / 100;
-            chip8->memory[cpu->I + 1] = (cpu->V[X] / 10) % 10;
-            chip8->memory[cpu->I + 2] = cpu->V[X] % 10;
+            chip8_write(chip8, cpu->I + 0, cpu->V[X] / 100);
+            chip8_write(chip8, cpu->I + 1, (cpu->V[X] / 10) % 10);
+            chip8_write(chip8, cpu->I + 2, cpu->V[X] % 10);
             break;
         case 0x55:                                                              /* LD [I], Vx */
             for (size_t i = 0; i <= X; ++i) {
-                chip8->memory[cpu->I++] = cpu->V[i];
+                chip8_write(chip8, cpu->I + i, cpu->V[i]);
+            }
+            if (chip8->quirks & QUIRK_MEMORY_INCREMENT) {
+                cpu->I += X + 1;
             }
             break;
         case 0x65:                                                              /* LD Vx, [I] */
             for (size_t i = 0; i <= X; ++i) {
-                cpu->V[i] = chip8->memory[cpu->I++];
+                cpu->V[i] = chip8_read(chip8, cpu->I + i);
+            }
+            if (chip8->quirks & QUIRK_MEMORY_INCREMENT) {
+                cpu->I += X + 1;
+            }
+            break;
+        case 0x75:                                                              /* LD R, Vx, SCHIP */
+            if (chip8->ext != NULL) {
+                memcpy(chip8->ext->flags, cpu->V, X + 1);
+            }
+            break;
+        case 0x85:                                                              /* LD Vx, R, SCHIP */
+            if (chip8->ext != NULL) {
+                memcpy(cpu->V, chip8->ext->flags, X + 1);
             }
             break;
         default:
@@ -260,10 +527,66 @@ static void priv_FXnn(chip8_t* chip8, uint8_t X, uint8_t nn) {
     }
 }
 
+static void priv_DXYn_extended(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {   /* SCHIP / XO-CHIP: 16x16 sprites, planes, 128 wide rows */
+    cpu_t* cpu = &chip8->cpu;
+    display_mode_t mode = chip8->display_mode;
+    int words = DISPLAY_ROW_WORDS(mode);
+    int wide = n == 0, height = wide ? 16 : n;
+    int x = cpu->V[X] & (mode.width - 1), y = cpu->V[Y] & (mode.height - 1);
+    int word = x >> 6, shift = x & 63;
+    int next = word + 1 < words ? word + 1 : ((chip8->quirks & QUIRK_WRAP) ? 0 : -1);     /* word the sprite spills into */
+    uint16_t addr = cpu->I;
+
+    cpu->V[0xF] = 0;
+
+    for (int p = 0; p < mode.nb_planes; p++) {
+        uint64_t* plane = chip8->display + p * DISPLAY_PLANE_WORDS(mode);
+
+        if (!BIT_CHECK(chip8->planes, p)) continue;                           /* both planes selected: plane 2 data follows plane 1 */
+
+        for (int i = 0; i < height; i++) {
+            uint64_t sprite, left, right;
+            uint64_t* row;
+            int r = y + i;
+
+            if (wide) {
+                sprite = (uint64_t)chip8_fetch(chip8, addr) << 48;
+                addr += 2;
+            } else {
+                sprite = (uint64_t)chip8_read(chip8, addr) << 56;
+                addr += 1;
+            }
+
+            if (r >= mode.height) {
+                if (!(chip8->quirks & QUIRK_WRAP)) continue;
+                r -= mode.height;
+            }
+            row = plane + r * words;
+
+            left = sprite >> shift;
+            right = shift > 0 ? sprite << (64 - shift) : 0;
+
+            if ((row[word] & left) || (next >= 0 && (row[next] & right))) {
+                cpu->V[0xF] = 1;
+            }
+            row[word] ^= left;
+            if (next >= 0) {
+                row[next] ^= right;
+            }
+        }
+    }
+    chip8->display_dirty = TRUE;
+}
+
 static void priv_DXYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
     cpu_t* cpu = &chip8->cpu;
     uint8_t x, y;
 
+    if (chip8->ext != NULL) {
+        priv_DXYn_extended(chip8, X, Y, n);
+        return;
+    }
+
     x = cpu->V[X] % CHIP8_DISPLAY_WIDTH;
     y = cpu->V[Y] % CHIP8_DISPLAY_HEIGHT;
     cpu->V[0xF] = 0;
@@ -271,28 +594,19 @@ static void priv_DXYn(chip8_t* chip8, uint8_t X, uint8_t Y, uint8_t n) {
     for (size_t i = 0; i < n; ++i) {
         if (y >= CHIP8_DISPLAY_HEIGHT) { break; }
 
-        uint8_t byte = chip8->memory[cpu->I + i];
-        for (size_t j = 0; j < 8; ++j) {
-            if (x + j >= CHIP8_DISPLAY_WIDTH) { break; }
+        uint64_t row = ((uint64_t)chip8_read(chip8, cpu->I + i) << 56) >> x;     /* columns past the right edge fall off */
 
-            size_t pos = y * CHIP8_DISPLAY_WIDTH + (x + j);
-            uint8_t pixel = (byte >> (7 - j)) & 1;
-
-            if (pixel == 1 && chip8->display[pos] == 1) {
-                cpu->V[0xF] = 1;
-            }
-
-            chip8->display[pos] ^= pixel;
+        if (chip8->display[y] & row) {
+            cpu->V[0xF] = 1;
         }
+        chip8->display[y] ^= row;
         ++y;
     }
+    chip8->display_dirty = TRUE;
 
     if (chip8->ips == DEFAULT_UPDATE_RATE_CHIP8) {
         chip8->wait_next_frame = TRUE;
     }
-    if (chip8->rendering_mode == CLI || chip8->rendering_mode == DEBUG) {
-        priv_render(chip8);
-    }
 }
 
 static void priv_update_chip8(chip8_t* chip8) {
@@ -302,7 +616,7 @@ static void priv_update_chip8(chip8_t* chip8) {
     uint16_t opcode, addr;
     uint8_t n, X, Y, kk;
 
-    opcode = (chip8->memory[cpu->PC] << 8) | (chip8->memory[cpu->PC + 1]);
+    opcode = chip8_fetch(chip8, cpu->PC);
     cpu->PC += 2;
 
     addr = opcode & 0x0FFF;
@@ -314,34 +628,34 @@ static void priv_update_chip8(chip8_t* chip8) {
     switch ((opcode & 0xF000) >> 12) {
         case 0x0:
             if (opcode == 0x00E0) {                                             /* CLS */
-                priv_clear_display(chip8->display);
+                priv_clear_planes(chip8, chip8->planes);
             } else if (opcode == 0x00EE) {                                      /* RET */
-                cpu->SP--;
-                cpu->PC = cpu->stack[cpu->SP & 0xF];
+                cpu->SP = (cpu->SP - 1) & STACK_MASK;
+                cpu->PC = cpu->stack[cpu->SP];
+            } else if (chip8->ext != NULL) {                                    /* see priv_00nn() */
+                priv_00nn(chip8, opcode);
             }
             break;
         case 0x1:                                                            /* JMP addr */
             cpu->PC = addr;
             break;
         case 0x2:                                                            /* CALL addr */
-            cpu->stack[cpu->SP & 0xF] = cpu->PC;
-            cpu->SP++;
+            cpu->stack[cpu->SP] = cpu->PC;
+            cpu->SP = (cpu->SP + 1) & STACK_MASK;
             cpu->PC = addr;
             break;
         case 0x3:                                                            /* SE V, byte */
             if (cpu->V[X] == kk) {
-                cpu->PC += 2;
+                priv_skip(chip8);
             }
             break;
         case 0x4:                                                            /* SNE V, byte */
             if (cpu->V[X] != kk) {
-                cpu->PC += 2;
+                priv_skip(chip8);
             }
             break;
-        case 0x5:                                                            /* SE Vx, Vy */
-            if (n == 0x0 && cpu->V[X] == cpu->V[Y]) {
-                cpu->PC += 2;
-            }
+        case 0x5:                                                            /* see priv_5XYn() */
+            priv_5XYn(chip8, X, Y, n);
             break;
         case 0x6:                                                            /* LD Vx, byte */
             cpu->V[X] = kk;
@@ -354,17 +668,17 @@ static void priv_update_chip8(chip8_t* chip8) {
             break;
         case 0x9:                                                            /* SNE Vx, Vy */
             if (n == 0x0 && cpu->V[X] != cpu->V[Y]) {
-                cpu->PC += 2;
+                priv_skip(chip8);
             }
             break;
         case 0xA:                                                            /* LD I, addr */
             cpu->I = addr;
             break;
         case 0xB:                                                            /* JP V0, addr */
-            cpu->PC = addr + cpu->V[0x0];
+            cpu->PC = addr + cpu->V[(chip8->quirks & QUIRK_JUMP_VX) ? X : 0x0];
             break;
         case 0xC:                                                            /* RND Vx, byte */
-            cpu->V[X] = (rand() % 0x100) & kk;
+            cpu->V[X] = priv_rand(chip8) & kk;
             break;
         case 0xD:                                                            /* see priv_DXYn() */
             priv_DXYn(chip8, X, Y, n);
@@ -380,13 +694,280 @@ static void priv_update_chip8(chip8_t* chip8) {
     }
 }
 
-static void priv_render(chip8_t* chip8) {                                       /* execute when display is modified */
-    if (chip8->rendering_mode == CLI || chip8->rendering_mode == DEBUG) {
-        cli_print_display(chip8->display);
+static void priv_traced_update(chip8_t* chip8) {
+    cpu_t before = chip8->cpu;
+    uint16_t opcode = chip8_fetch(chip8, before.PC);
+
+    priv_update_chip8(chip8);
+    trace_instruction(chip8->trace, &before, chip8, opcode);
+}
+
+static inline void priv_execute(chip8_t* chip8) {                               /* main loops only, the core API stays untraced */
+    if (chip8->wait_next_frame) return;
+
+    if (chip8->trace != NULL) {
+        priv_traced_update(chip8);
+    } else {
+        priv_update_chip8(chip8);
+    }
+    chip8->nb_instructions++;
+}
+
+static inline void priv_execute_timed(chip8_t* chip8) {                         /* --timing vip, charges the instruction to the frame budget */
+    uint16_t pc = chip8->cpu.PC;
+    uint16_t opcode = chip8_fetch(chip8, pc);
+
+    priv_execute(chip8);
+    chip8->cycles -= timing_vip_cycles(chip8, opcode, pc);
+}
+
+static int priv_execute_sequence(chip8_t* chip8, fusion_entry_t* entry, int budget, int* idle) {      /* see priv_execute_fused() */
+    cpu_t* cpu = &chip8->cpu;
+    fusion_t* fusion = chip8->fusion;
+    int retired = 1;
+
+    if (entry->kind == FUSION_UNKNOWN) {
+        fusion_match(fusion, chip8, cpu->PC);
+    }
+    if (entry->length == 0 || budget < entry->length) {                         /* nothing fused, or the budget ends inside the sequence */
+        priv_update_chip8(chip8);
+        return 1;
+    }
+
+    switch (entry->kind) {
+        case FUSION_SPRITE_AT:                                                  /* 6XNN 6YNN DXYn */
+            cpu->V[entry->X] = entry->nn;
+            cpu->V[entry->Y] = entry->nn2;
+            cpu->PC += 6;
+            priv_DXYn(chip8, (entry->last >> 8) & 0xF, (entry->last >> 4) & 0xF, entry->last & 0xF);
+            retired = 3;
+            break;
+        case FUSION_SPRITE:                                                     /* ANNN DXYn */
+            cpu->I = entry->addr;
+            cpu->PC += 4;
+            priv_DXYn(chip8, (entry->last >> 8) & 0xF, (entry->last >> 4) & 0xF, entry->last & 0xF);
+            retired = 2;
+            break;
+        case FUSION_TIMER_WAIT:                                                 /* FX07 3XNN 1NNN */
+            cpu->V[entry->X] = cpu->DT;
+            if (cpu->V[entry->X] == entry->nn2) {                               /* skips the jump */
+                cpu->PC += 6;
+                retired = 2;
+            } else if (entry->addr == cpu->PC) {                                /* DT is fixed until the next frame, the iterations left are idle time */
+                retired = 3;
+                *idle = budget - budget % 3 - 3;
+                fusion->nb_idle += *idle;
+            } else {
+                cpu->PC = entry->addr;
+                retired = 3;
+            }
+            break;
+        case FUSION_INDEXED_LOAD:                                               /* FX1E FY65 */
+            cpu->I += cpu->V[entry->X];
+            cpu->PC += 4;
+            priv_FXnn(chip8, entry->Y, 0x65);
+            retired = 2;
+            break;
+        case FUSION_COUNTER:                                                    /* 7XNN 3XNN / 4XNN */
+            cpu->V[entry->X] += entry->nn;
+            cpu->PC += 4;
+            if ((cpu->V[entry->X] == entry->nn2) == ((entry->last >> 12) == 0x3)) {
+                priv_skip(chip8);
+            }
+            retired = 2;
+            break;
+        default:
+            break;
+    }
+
+    fusion->sequences[entry->kind]++;
+    fusion->instructions[entry->kind] += retired;
+
+    return retired;
+}
+
+static inline int priv_execute_fused(chip8_t* chip8, int budget, int* idle) {  /* one dispatch, returns the instructions retired, idle adds the budget a timer wait skipped, see fusion.h */
+    fusion_entry_t* entry = &chip8->fusion->entries[chip8->cpu.PC & chip8->memory_mask];
+
+    if (entry->kind == FUSION_NONE) {                                           /* most instructions, kept inline */
+        priv_update_chip8(chip8);
+        return 1;
+    }
+
+    return priv_execute_sequence(chip8, entry, budget, idle);
+}
+
+static void priv_execute_frame(chip8_t* chip8, int budget) {                   /* one frame worth of instructions, or of cycles with --timing vip */
+    if (chip8->timing == TIMING_VIP) {
+        while (chip8->cycles > 0 && !chip8->wait_next_frame) {
+            priv_execute_timed(chip8);
+        }
+        return;
+    }
+
+    if (chip8->fusion != NULL) {
+        for (int i = 0; i < budget && !chip8->wait_next_frame;) {
+            int idle = 0;
+            int retired = priv_execute_fused(chip8, budget - i, &idle);
+
+            i += retired + idle;
+            chip8->nb_instructions += retired;                                  /* idle time is not instructions, nor IPS */
+        }
+        return;
+    }
+
+    for (int i = 0; i < budget && !chip8->wait_next_frame; ++i) {
+        priv_execute(chip8);
+    }
+}
+
+static void priv_print_stats(const chip8_t* chip8, double elapsed) {
+    printf("frames:        %" PRIu64 "\n", chip8->nb_frames);
+    printf("instructions:  %" PRIu64 "\n", chip8->nb_instructions);
+    printf("elapsed:       %.3f s\n", elapsed);
+    printf("achieved IPS:  %.0f\n", elapsed > 0 ? chip8->nb_instructions / elapsed : 0.0);
+    if (chip8->watchdog != NULL) {
+        watchdog_print(chip8->watchdog);
+    }
+    if (chip8->fusion != NULL) {
+        fusion_print(chip8->fusion, chip8->nb_instructions);
+    }
+}
+
+static void priv_headless_main_loop(chip8_t* chip8) {                           /* unthrottled, max_frames frames */
+    struct timespec start, end;
+    int budget = chip8->ips / UPDATE_RATE_60HZ;
+    int changed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (chip8->running && chip8->nb_frames < (uint64_t)chip8->max_frames) {
+        priv_phase(chip8, PERF_CPU);
+        priv_execute_frame(chip8, budget);
+        priv_phase(chip8, PERF_TIMERS);
+        chip8_next_frame(chip8, chip8->keys_current_state);
+
+        priv_phase(chip8, PERF_INPUT);
+        changed = chip8->display_dirty;                                         /* frame boundary counts as presented */
+        chip8->display_dirty = FALSE;
+        if (chip8->latency != NULL) {
+            latency_present(chip8->latency, chip8, changed);
+        }
+        if (chip8->keyscript != NULL) {
+            uint16_t keys = keyscript_keys(chip8->keyscript, chip8->nb_frames);
+
+            if (chip8->latency != NULL) {
+                latency_keys(chip8->latency, chip8, chip8->keys_current_state, keys);
+            }
+            chip8->keys_current_state = keys;
+        }
+        if (chip8->watchdog != NULL) {
+            int inputs_fixed = chip8->keyscript == NULL || keyscript_done(chip8->keyscript);
+
+            priv_phase(chip8, PERF_OTHER);
+            if (watchdog_check(chip8->watchdog, chip8, changed, inputs_fixed) != WATCHDOG_RUNNING) {
+                chip8->running = FALSE;
+            }
+        }
+
+        if (chip8->trace != NULL) {
+            priv_phase(chip8, PERF_OTHER);
+            trace_frame(chip8->trace, chip8);
+        }
+    }
+    priv_phase(chip8, PERF_OTHER);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    priv_print_stats(chip8, (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1.0e9);
+}
+
+static void priv_debug_main_loop(chip8_t* chip8) {                               /* chip8_main_loop() with breakpoints, only used in DEBUG */
+    debugger_t* debugger = chip8->debugger;
+    struct timespec last_60Hz_update = { 0 };
+
+    while (chip8->running) {
+        int ready = !debugger->paused && !chip8->wait_next_frame && (chip8->timing == TIMING_FLAT || chip8->cycles > 0);
+
+        priv_phase(chip8, PERF_CPU);
+        if (ready && !debugger_check(debugger, chip8)) {
+            if (chip8->timing == TIMING_VIP) {
+                priv_execute_timed(chip8);
+            } else {
+                priv_execute(chip8);
+            }
+
+            if (debugger_has_step_action(debugger)) {
+                debugger_after_step(debugger, chip8);
+            }
+        }
+        priv_delayed_update(chip8, &last_60Hz_update, UPDATE_RATE_60HZ);
+
+        if (chip8->timing == TIMING_FLAT) {
+            usleep(1000000 / chip8->ips);
+        } else if (!ready) {                                                    /* frame budget spent, poll for the next tick */
+            usleep(1000);
+        }
+    }
+}
+
+static void priv_burst_main_loop(chip8_t* chip8) {                              /* --timing vip, one burst per frame then sleep until the next tick */
+    struct timespec deadline, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (chip8->running) {
+        priv_phase(chip8, PERF_CPU);
+        priv_execute_frame(chip8, 0);
+
+        priv_phase(chip8, PERF_OTHER);
+        deadline.tv_nsec += 1000000000 / UPDATE_RATE_60HZ;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec) {                                     /* a second behind (stopped, slow frontend), dont catch up */
+            deadline = now;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+
+        priv_frame_update(chip8);
+    }
+}
+
+static void priv_render(chip8_t* chip8, const uint64_t* display, display_mode_t mode, int changed) {
+    perf_phase_t previous = priv_phase(chip8, PERF_RENDER);
+
+    if ((chip8->rendering_mode == CLI || chip8->rendering_mode == DEBUG) && changed) {
+        cli_print_display(display, mode);
     } else if (chip8->rendering_mode == GUI) {
-        gui_set_buffer(chip8->gui, chip8->display);
-        gui_render(chip8->gui);
+        if (changed) {
+            gui_set_buffer(chip8->gui, display, mode);
+        }
+        gui_render(chip8->gui);                                                 /* every frame, raylib polls events while drawing */
+    }
+    priv_phase(chip8, previous);
+}
+
+static void priv_present(chip8_t* chip8) {                                      /* once per 60Hz frame, after input so run-ahead sees the new keys */
+    const uint64_t* display = chip8->display;
+    display_mode_t mode = chip8->display_mode;
+    int changed = chip8->display_dirty;
+
+    if (chip8->runahead != NULL) {                                              /* paused: show the core, breakpoints would not stop a run-ahead */
+        int paused = chip8->debugger != NULL && chip8->debugger->paused;
+
+        priv_phase(chip8, PERF_CPU);
+        changed = runahead_present(chip8->runahead, chip8, paused ? 0 : chip8->runahead->frames);
+        display = chip8->runahead->display;
+        mode = chip8->runahead->display_mode;
     }
+    chip8->display_dirty = FALSE;
+
+    if (chip8->latency != NULL) {
+        latency_present(chip8->latency, chip8, changed);
+    }
+    priv_render(chip8, display, mode, changed);
 }
 
 
@@ -394,58 +975,413 @@ static void priv_render(chip8_t* chip8) {
  *                 Public functions                   *
  ******************************************************/
 
-chip8_t* chip8_init(const char* rom_path, rendering_mode_t mode, int scale, int show_grid, int ips) {
+chip8_t* chip8_init(const args_t* args) {
+    static const int default_ips[] = {
+        [VARIANT_CHIP8] = DEFAULT_UPDATE_RATE_CHIP8,
+        [VARIANT_SCHIP] = DEFAULT_UPDATE_RATE_SCHIP,
+        [VARIANT_XOCHIP] = DEFAULT_UPDATE_RATE_XOCHIP,
+    };
+    rendering_mode_t mode = args->rendering_mode;
     chip8_t* chip8;
+    rom_t* rom;
 
-    chip8 = calloc(1, sizeof(chip8_t));
-    if (chip8 == NULL) {
-        printf("[ERROR] Cant allocate rom memory\n");
+    if (args->timing == TIMING_VIP && args->variant != VARIANT_CHIP8) {
+        printf("[ERROR] --timing vip only models CHIP-8 on the COSMAC VIP\n");
         exit(EXIT_FAILURE);
     }
 
-    priv_load_rom(chip8, rom_path);
-    memcpy(chip8->memory + FONT_START_ADR, font, FONT_SIZE);
+    rom = rom_load(args->rom_path);
+    if (args->variant != VARIANT_XOCHIP && rom->len > MEMORY_SIZE - ROM_START_ADR) {
+        printf("[ERROR] Rom too large for 4 KB of memory, XO-CHIP roms need --variant xochip\n");
+        exit(EXIT_FAILURE);
+    }
+    chip8 = chip8_create(rom);
+    rom_release(rom);
+    if (args->variant != VARIANT_CHIP8) {
+        chip8_set_variant(chip8, args->variant);
+    }
 
     chip8->rendering_mode = mode;
+    chip8->ips = args->ips == 0 ? default_ips[args->variant] : args->ips;
+    chip8->timing = args->timing;
+    chip8->rom_path = args->rom_path;
+    chip8->keep_state = args->keep_state;
+    chip8->watch_fd = args->watch ? priv_watch_rom(args->rom_path) : -1;
+    chip8->max_frames = args->frames == 0 ? DEFAULT_HEADLESS_FRAMES : args->frames;
+    chip8->trace = args->trace_path != NULL ? trace_open(args->trace_path) : NULL;
+    chip8->perf = args->perf_counters ? perf_open() : NULL;
+    chip8->latency = args->latency ? latency_open(mode == HEADLESS) : NULL;
+    chip8->keyscript = args->input_path != NULL && mode == HEADLESS ? keyscript_load(args->input_path) : NULL;
+    chip8->watchdog = args->watchdog && mode == HEADLESS ? watchdog_open() : NULL;
+    chip8->fusion = args->fusion && mode == HEADLESS && args->timing == TIMING_FLAT && chip8->trace == NULL ? fusion_open() : NULL;     /* traces record every instruction */
+    chip8->rng = chip8->keyscript != NULL ? DEFAULT_RNG_SEED : (uint32_t)time(NULL) | 1;      /* scripted runs replay exactly */
+
+    if (chip8->fusion != NULL) {                                                /* block map from the disk cache, see analysis.h */
+        analysis_t* analysis = analysis_load(chip8->rom, chip8->variant);
+
+        fusion_seed(chip8->fusion, chip8, analysis);
+        analysis_free(analysis);
+    }
+
+    if (args->run_ahead > 0 && mode != HEADLESS) {
+        chip8->runahead = malloc(sizeof(runahead_t));
+        runahead_init(chip8->runahead, args->run_ahead);
+    }
 
     if (mode == CLI || mode == DEBUG) {
         cli_init();
+    }
+    if (mode == DEBUG) {
+        chip8->debugger = malloc(sizeof(debugger_t));
+        debugger_init(chip8->debugger, args);
     } else if (mode == GUI) {
         chip8->gui = malloc(sizeof(gui_t));
-        gui_init(chip8->gui, "Chip8", scale, show_grid);
+        gui_init(chip8->gui, "Chip8", args->scale, args->show_grid);
     }
 
-    chip8->cpu.PC = 0x200;
-    chip8->wait_next_frame = FALSE;
-    chip8->ips = ips == 0 ? DEFAULT_UPDATE_RATE_CHIP8 : ips;
     chip8->running = TRUE;
 
-    srand(time(NULL));
     signal(SIGINT, priv_signal_callback_handler);
 
-    priv_render(chip8);
+    priv_render(chip8, chip8->display, chip8->display_mode, TRUE);
 
     return chip8;
 }
 
 void chip8_quit(chip8_t* chip8) {
+    if (chip8->watch_fd >= 0) {
+        close(chip8->watch_fd);
+    }
+
     if (chip8->rendering_mode == CLI || chip8->rendering_mode == DEBUG) {
         cli_quit();
     } else if (chip8->rendering_mode == GUI) {
         gui_quit();
         free(chip8->gui);
     }
+    free(chip8->debugger);
+    free(chip8->runahead);
+
+    if (chip8->perf != NULL) {                                                  /* after the frontends, the terminal is restored */
+        perf_print(chip8->perf, chip8->nb_instructions, chip8->nb_frames);
+        perf_close(chip8->perf);
+    }
+    if (chip8->latency != NULL) {
+        latency_print(chip8->latency);
+        latency_close(chip8->latency);
+    }
+    if (chip8->keyscript != NULL) {
+        keyscript_free(chip8->keyscript);
+    }
+    if (chip8->watchdog != NULL) {
+        watchdog_close(chip8->watchdog);
+    }
+
+    if (chip8->trace != NULL) {
+        trace_close(chip8->trace);
+    }
 
-    free(chip8);
+    chip8_destroy(chip8);
 }
 
 void chip8_main_loop(chip8_t* chip8) {
     struct timespec last_60Hz_update = { 0 };
 
+    if (chip8->debugger != NULL) {
+        priv_debug_main_loop(chip8);
+        return;
+    }
+
+    if (chip8->rendering_mode == HEADLESS) {
+        priv_headless_main_loop(chip8);
+        return;
+    }
+
+    if (chip8->timing == TIMING_VIP) {
+        priv_burst_main_loop(chip8);
+        return;
+    }
+
     while (chip8->running) {
-        priv_update_chip8(chip8);
+        priv_phase(chip8, PERF_CPU);                                            /* the frame check below counts as cpu */
+        priv_execute(chip8);
         priv_delayed_update(chip8, &last_60Hz_update, UPDATE_RATE_60HZ);
 
         usleep(1000000 / chip8->ips);
     }
 }
+
+chip8_t* chip8_create(rom_t* rom) {
+    chip8_t* chip8 = pool_alloc(&instance_pool);
+
+    memset(chip8, 0, sizeof(chip8_t));
+    rom_retain(rom);
+    chip8->rom = rom;
+
+    chip8->rendering_mode = HEADLESS;
+    chip8->ips = DEFAULT_UPDATE_RATE_CHIP8;
+    chip8->rng = DEFAULT_RNG_SEED;
+    chip8->watch_fd = -1;
+    chip8->running = TRUE;
+    chip8_set_variant(chip8, VARIANT_CHIP8);
+
+    return chip8;
+}
+
+void chip8_destroy(chip8_t* chip8) {
+    for (int i = 0; i < chip8_nb_pages(chip8); i++) {
+        page_release(chip8->pages[i]);
+    }
+    rom_release(chip8->rom);
+    free(chip8->ext);
+    if (chip8->fusion != NULL) {
+        fusion_close(chip8->fusion);
+    }
+
+    pool_free(&instance_pool, chip8);
+}
+
+chip8_t* chip8_fork(chip8_t* parent) {                                          /* no page copy, like chip8_save_state() */
+    chip8_t* child = pool_alloc(&instance_pool);
+
+    memcpy(child, parent, sizeof(chip8_t));
+    if (parent->ext != NULL) {
+        child->ext = malloc(sizeof(chip8_ext_t));
+        if (child->ext == NULL) {
+            printf("[ERROR] Cant allocate SCHIP / XO-CHIP state\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(child->ext, parent->ext, sizeof(chip8_ext_t));
+    }
+    child->pages = parent->pages == parent->page_table ? child->page_table : child->ext->pages;
+    child->display = parent->display == parent->screen ? child->screen : child->ext->display;
+
+    for (int i = 0; i < chip8_nb_pages(child); i++) {
+        page_retain(child->pages[i]);
+    }
+    memset(parent->owned_pages, 0, sizeof(parent->owned_pages));
+    memset(child->owned_pages, 0, sizeof(child->owned_pages));
+    rom_retain(child->rom);
+
+    child->gui = NULL;                                                          /* frontends and tools stay with the parent */
+    child->debugger = NULL;
+    child->trace = NULL;
+    child->perf = NULL;
+    child->runahead = NULL;
+    child->latency = NULL;
+    child->keyscript = NULL;
+    child->watchdog = NULL;
+    child->fusion = NULL;
+    child->rendering_mode = HEADLESS;
+    child->rom_path = NULL;
+    child->watch_fd = -1;
+    child->keep_state = FALSE;
+
+    return child;
+}
+
+void chip8_set_rom(chip8_t* chip8, rom_t* rom) {
+    rom_retain(rom);
+    rom_release(chip8->rom);
+    chip8->rom = rom;
+}
+
+void chip8_set_variant(chip8_t* chip8, variant_t variant) {
+    static const uint8_t quirks[] = {
+        [VARIANT_CHIP8] = QUIRK_VF_RESET | QUIRK_MEMORY_INCREMENT | QUIRK_SHIFT_VY,
+        [VARIANT_SCHIP] = QUIRK_JUMP_VX,
+        [VARIANT_XOCHIP] = QUIRK_MEMORY_INCREMENT | QUIRK_SHIFT_VY | QUIRK_WRAP | QUIRK_LONG_SKIP,
+    };
+
+    for (int i = 0; i < chip8_nb_pages(chip8); i++) {
+        page_release(chip8->pages[i]);
+    }
+
+    if (variant == VARIANT_CHIP8) {
+        free(chip8->ext);
+        chip8->ext = NULL;
+    } else if (chip8->ext == NULL) {
+        chip8->ext = calloc(1, sizeof(chip8_ext_t));
+        if (chip8->ext == NULL) {
+            printf("[ERROR] Cant allocate SCHIP / XO-CHIP state\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    chip8->variant = variant;
+    chip8->quirks = quirks[variant];
+    chip8->memory_mask = variant == VARIANT_XOCHIP ? MEMORY_MAX_SIZE - 1 : MEMORY_MASK;
+    chip8->pages = variant == VARIANT_XOCHIP ? chip8->ext->pages : chip8->page_table;
+    chip8->display = chip8->ext != NULL ? chip8->ext->display : chip8->screen;
+    chip8->display_mode.nb_planes = variant == VARIANT_XOCHIP ? DISPLAY_MAX_PLANES : 1;
+
+    for (int i = 0; i < chip8_nb_pages(chip8); i++) {                           /* chip8_reset() swaps them for the rom pages */
+        chip8->pages[i] = rom_page(chip8->rom, i);
+        page_retain(chip8->pages[i]);
+    }
+    chip8_reset(chip8);
+}
+
+void chip8_reset(chip8_t* chip8) {                                              /* keeps ips, rng, variant and frontend state */
+    if (chip8->fusion != NULL) {                                                /* rom reload or variant change */
+        fusion_flush(chip8->fusion);
+    }
+    for (int i = 0; i < chip8_nb_pages(chip8); i++) {                           /* back to the shared rom pages */
+        page_t* page = rom_page(chip8->rom, i);
+
+        if (i == BIG_FONT_START_ADR >> PAGE_SHIFT && chip8->ext != NULL) {      /* empty in every rom image */
+            page = page_big_font();
+        }
+        if (chip8->pages[i] != page) {
+            page_retain(page);
+            page_release(chip8->pages[i]);
+            chip8->pages[i] = page;
+        }
+    }
+    memset(chip8->owned_pages, 0, sizeof(chip8->owned_pages));
+
+    memset(&chip8->cpu, 0, sizeof(cpu_t));
+    chip8->display_mode.width = CHIP8_DISPLAY_WIDTH;
+    chip8->display_mode.height = CHIP8_DISPLAY_HEIGHT;
+    chip8->planes = 0x1;
+    priv_clear_planes(chip8, 0xFF);
+
+    chip8->cpu.PC = ROM_START_ADR;
+    chip8->keys_last_state = 0;
+    chip8->keys_current_state = 0;
+    chip8->wait_next_frame = FALSE;
+    chip8->cycles = TIMING_VIP_FRAME_CYCLES;                                    /* budget of the first frame, --timing vip only */
+}
+
+size_t chip8_footprint(const chip8_t* chip8) {
+    size_t nb_owned = 0;
+
+    for (int i = 0; i < NB_MAX_PAGES / 64; i++) {
+        nb_owned += __builtin_popcountll(chip8->owned_pages[i]);
+    }
+
+    return sizeof(chip8_t) + (chip8->ext != NULL ? sizeof(chip8_ext_t) : 0) + nb_owned * sizeof(page_t);
+}
+
+void chip8_save_state(chip8_t* chip8, chip8_state_t* state) {                  /* no page copy, both sides copy on their next write */
+    state->nb_pages = chip8_nb_pages(chip8);
+    for (int i = 0; i < state->nb_pages; i++) {
+        state->pages[i] = chip8->pages[i];
+        page_retain(state->pages[i]);
+    }
+    memset(chip8->owned_pages, 0, sizeof(chip8->owned_pages));
+
+    state->cpu = chip8->cpu;
+    state->display_mode = chip8->display_mode;
+    state->planes = chip8->planes;
+    memcpy(state->display, chip8->display, chip8_display_size(chip8));
+    if (chip8->ext != NULL) {
+        memcpy(state->flags, chip8->ext->flags, NB_FLAGS);
+    }
+    state->keys_last_state = chip8->keys_last_state;
+    state->keys_current_state = chip8->keys_current_state;
+    state->rng = chip8->rng;
+    state->wait_next_frame = chip8->wait_next_frame;
+    state->cycles = chip8->cycles;
+    state->nb_frames = chip8->nb_frames;
+}
+
+void chip8_load_state(chip8_t* chip8, const chip8_state_t* state) {
+    for (int i = 0; i < state->nb_pages; i++) {
+        if (chip8->pages[i] != state->pages[i]) {
+            if (chip8->fusion != NULL) {
+                fusion_invalidate_page(chip8->fusion, i, chip8->memory_mask);
+            }
+            page_retain(state->pages[i]);
+            page_release(chip8->pages[i]);
+            chip8->pages[i] = state->pages[i];
+        }
+    }
+    memset(chip8->owned_pages, 0, sizeof(chip8->owned_pages));
+
+    chip8->cpu = state->cpu;
+    chip8->display_mode = state->display_mode;
+    chip8->planes = state->planes;
+    memcpy(chip8->display, state->display, chip8_display_size(chip8));
+    if (chip8->ext != NULL) {
+        memcpy(chip8->ext->flags, state->flags, NB_FLAGS);
+    }
+    chip8->display_dirty = TRUE;
+    chip8->keys_last_state = state->keys_last_state;
+    chip8->keys_current_state = state->keys_current_state;
+    chip8->rng = state->rng;
+    chip8->wait_next_frame = state->wait_next_frame;
+    chip8->cycles = state->cycles;
+    chip8->nb_frames = state->nb_frames;
+}
+
+void chip8_release_state(chip8_state_t* state) {
+    for (int i = 0; i < state->nb_pages; i++) {
+        page_release(state->pages[i]);
+    }
+}
+
+void chip8_own_page(chip8_t* chip8, int index) {                                /* first store to a page, see chip8_write() */
+    page_make_private(&chip8->pages[index]);
+    chip8->owned_pages[index >> 6] |= 1ULL << (index & 63);
+}
+
+void chip8_step(chip8_t* chip8) {
+    priv_update_chip8(chip8);
+}
+
+int chip8_engine_reference(chip8_t* chip8, int budget) {                       /* one instruction per call, see priv_update_chip8() */
+    if (budget <= 0 || chip8->wait_next_frame) return 0;
+
+    priv_update_chip8(chip8);
+
+    return 1;
+}
+
+int chip8_engine_fused(chip8_t* chip8, int budget) {                           /* a whole fused sequence per call when one starts at PC */
+    int idle = 0;
+    int retired;
+
+    if (budget <= 0 || chip8->wait_next_frame) return 0;
+
+    if (chip8->fusion == NULL) {
+        chip8->fusion = fusion_open();
+    }
+
+    retired = priv_execute_fused(chip8, budget, &idle);
+
+    return retired + idle;                                                      /* what the reference runs to reach the same state */
+}
+
+void chip8_next_frame(chip8_t* chip8, uint16_t keys) {                         /* 60Hz tick, keys are the state held during the next frame */
+    priv_update_timers(chip8);
+
+    if (chip8->timing == TIMING_VIP) {                                          /* cycles left are idle time, a debt carries over */
+        chip8->cycles = (chip8->cycles < 0 ? chip8->cycles : 0) + TIMING_VIP_FRAME_CYCLES;
+    }
+
+    chip8->wait_next_frame = FALSE;
+    chip8->keys_last_state = chip8->keys_current_state;
+    chip8->keys_current_state = keys;
+    chip8->nb_frames++;
+}
+
+void chip8_run_frame(chip8_t* chip8, uint16_t keys) {
+    int budget = chip8->ips / UPDATE_RATE_60HZ;
+
+    if (chip8->timing == TIMING_VIP) {
+        while (chip8->cycles > 0 && !chip8->wait_next_frame) {
+            uint16_t pc = chip8->cpu.PC;
+            uint16_t opcode = chip8_fetch(chip8, pc);
+
+            priv_update_chip8(chip8);
+            chip8->cycles -= timing_vip_cycles(chip8, opcode, pc);
+        }
+    } else {
+        for (int i = 0; i < budget && !chip8->wait_next_frame; ++i) {
+            priv_update_chip8(chip8);
+        }
+    }
+
+    chip8_next_frame(chip8, keys);
+}
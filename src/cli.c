@@ -3,14 +3,26 @@
 #include <unistd.h>
 #include <termios.h>
 #include <sys/select.h>
+#include <inttypes.h>
 
 #include "common.h"
+#include "debugger.h"
+#include "latency.h"
+#include "runahead.h"
 
 
 /******************************************************
  *                 Private functions                  *
  ******************************************************/
 
+static const uint8_t braille_dots[4][2] = {                                     /* [row][col] of a 2x4 braille cell, U+2800 + dots */
+    { 0x01, 0x08 },
+    { 0x02, 0x10 },
+    { 0x04, 0x20 },
+    { 0x40, 0x80 },
+};
+
+
 static void priv_set_buffered_input(int enable) {
     static int enabled = 1;
     static struct termios old;
@@ -49,6 +61,17 @@ static uint16_t priv_get_key_pressed() {
     return key;
 }
 
+static int priv_pixel(const uint64_t* display, display_mode_t mode, size_t x, size_t y) {    /* planes ORed */
+    const uint64_t* word = display + y * DISPLAY_ROW_WORDS(mode) + x / 64;
+    int pixel = 0;
+
+    for (int p = 0; p < mode.nb_planes; p++, word += DISPLAY_PLANE_WORDS(mode)) {
+        pixel |= DISPLAY_PIXEL(*word, x % 64);
+    }
+
+    return pixel;
+}
+
 static void priv_display_VX_registers(const chip8_t* chip8) {
     color_t color = GREEN_CLI;
 
@@ -125,6 +148,84 @@ static void priv_display_cpu(const chip8_t* chip8) {
     RESET_FORMATING();
 }
 
+static void priv_display_debugger(const chip8_t* chip8) {
+    const debugger_t* debugger = chip8->debugger;
+    color_t color = YELLOW_CLI;
+    uint16_t pc = chip8->cpu.PC;
+
+    SET_TEXT_COLOR(color);
+    MOVE_CURSOR(32, 44);
+    printf("┏━━━━━┓");
+    RESET_FORMATING(); PRINT_BOLD("Debugger");
+    SET_TEXT_COLOR(color); printf("┏━━━━┓");
+
+    MOVE_CURSOR(33, 44); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("%-17s", debugger->paused ? "PAUSED" : "RUNNING"); SET_TEXT_COLOR(color); printf(" ┃");
+    MOVE_CURSOR(34, 44); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("%-17.17s", debugger->reason); SET_TEXT_COLOR(color); printf(" ┃");
+    MOVE_CURSOR(35, 44); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("next "); PRINT_DIMED("->"); printf(" %03X:%04X ", pc & MEMORY_MASK, chip8_fetch(chip8, pc));
+    SET_TEXT_COLOR(color); printf(" ┃");
+    MOVE_CURSOR(36, 44); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    PRINT_DIMED("p n o g b        "); SET_TEXT_COLOR(color); printf(" ┃");
+
+    MOVE_CURSOR(37, 44); printf("┗━━━━━━━━━━━━━━━━━━━┛");
+    RESET_FORMATING();
+}
+
+static void priv_display_runahead(const chip8_t* chip8) {
+    const runahead_t* runahead = chip8->runahead;
+    color_t color = MAGENTA_CLI;
+    double confirmed = runahead->nb_checked > 0 ? 100.0 * runahead->nb_confirmed / runahead->nb_checked : 0.0;
+
+    SET_TEXT_COLOR(color);
+    MOVE_CURSOR(20, 67);
+    printf("┏━━━━┓");
+    RESET_FORMATING(); PRINT_BOLD("Run-ahead");
+    SET_TEXT_COLOR(color); printf("┏━━━━┓");
+
+    MOVE_CURSOR(21, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("ahead "); PRINT_DIMED("->"); printf(" %d frames ", runahead->frames); SET_TEXT_COLOR(color); printf("┃");
+    MOVE_CURSOR(22, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("nominal "); PRINT_DIMED("->"); printf(" %4.0f ms", runahead->frames * 1000.0 / UPDATE_RATE_60HZ); SET_TEXT_COLOR(color); printf("┃");     /* frames * 16.7 ms, not measured */
+    MOVE_CURSOR(23, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("cost  "); PRINT_DIMED("->"); printf(" %5.0f us ", runahead->cost * 1.0e6); SET_TEXT_COLOR(color); printf("┃");
+    MOVE_CURSOR(24, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("max   "); PRINT_DIMED("->"); printf(" %5.0f us ", runahead->max_cost * 1.0e6); SET_TEXT_COLOR(color); printf("┃");
+    MOVE_CURSOR(25, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("match "); PRINT_DIMED("->"); printf(" %5.1f %%  ", confirmed); SET_TEXT_COLOR(color); printf("┃");
+
+    MOVE_CURSOR(26, 67); printf("┗━━━━━━━━━━━━━━━━━━━┛");
+    RESET_FORMATING();
+}
+
+static void priv_display_latency(const chip8_t* chip8) {
+    const latency_t* latency = chip8->latency;
+    static const double percents[] = { 50, 95, 99 };
+    static const char* names[] = { "p50", "p95", "p99" };
+    color_t color = CYAN_CLI;
+
+    SET_TEXT_COLOR(color);
+    MOVE_CURSOR(27, 67);
+    printf("┏━━━━━┓");
+    RESET_FORMATING(); PRINT_BOLD("Latency");
+    SET_TEXT_COLOR(color); printf("┏━━━━━┓");
+
+    MOVE_CURSOR(28, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    PRINT_DIMED("ms    read  shown"); SET_TEXT_COLOR(color); printf(" ┃");
+    for (int i = 0; i < 3; i++) {
+        MOVE_CURSOR(29 + i, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+        printf("%s %6.1f %6.1f", names[i], latency_percentile(latency, LATENCY_CONSUME, percents[i]), latency_percentile(latency, LATENCY_PRESENT, percents[i]));
+        SET_TEXT_COLOR(color); printf(" ┃");
+    }
+    MOVE_CURSOR(32, 67); SET_TEXT_COLOR(color); printf("┃ "); RESET_FORMATING();
+    printf("n   %6" PRIu64 " %6" PRIu64, latency_count(latency, LATENCY_CONSUME), latency_count(latency, LATENCY_PRESENT));
+    SET_TEXT_COLOR(color); printf(" ┃");
+
+    MOVE_CURSOR(33, 67); printf("┗━━━━━━━━━━━━━━━━━━━┛");
+    RESET_FORMATING();
+}
+
 
 /******************************************************
  *                 Public functions                   *
@@ -140,9 +241,17 @@ void cli_quit() {
 }
 
 uint16_t cli_get_keys() {
-    char key = priv_get_key_pressed();
+    return cli_char_to_keys(priv_get_key_pressed());
+}
+
+char cli_get_char() {
+    return priv_get_key_pressed();
+}
+
+uint16_t cli_char_to_keys(char key) {
+    int chip8_key = get_key(key);
 
-    return key != 0 ? 1 << get_key(key) : 0;
+    return chip8_key >= 0 ? 1 << chip8_key : 0;
 }
 
 void cli_print_memory(const chip8_t* chip8) {
@@ -150,7 +259,7 @@ void cli_print_memory(const chip8_t* chip8) {
         if (i % 32 == 0) {
             printf("\n");
         }
-        uint8_t val = chip8->memory[MEMORY_SIZE - i - 1];
+        uint8_t val = chip8_read(chip8, MEMORY_SIZE - i - 1);
         if (val == 0x00) {
             printf("\033[2m0x%02X\033[0m ", val);
         } else {
@@ -160,25 +269,40 @@ void cli_print_memory(const chip8_t* chip8) {
     printf("\n");
 }
 
-void cli_print_display(const uint8_t* display) {
+void cli_print_display(const uint64_t* display, display_mode_t mode) {           /* 64x16 characters whatever the resolution */
+    int hires = mode.width > CHIP8_DISPLAY_WIDTH;
+
     MOVE_CURSOR(0, 0);
     RESET_FORMATING();
 
     PRINT_BOLD("╔═════════════════════════════╗Chip-8╔═════════════════════════════╗\n");
-    for (size_t r = 0; r < CHIP8_DISPLAY_HEIGHT; r += 2) {
+    for (size_t r = 0; r < CHIP8_DISPLAY_HEIGHT / 2; r++) {
         printf("║ ");
         for (size_t c = 0; c < CHIP8_DISPLAY_WIDTH; c++) {
-            int upper = r * CHIP8_DISPLAY_WIDTH + c;
-            int lower = (r + 1) * CHIP8_DISPLAY_WIDTH + c;
-
-            if (display[upper] == 1 && display[lower] == 1) {
-                printf("█");
-            } else if (display[upper] == 1) {
-                printf("▀");
-            } else if (display[lower] == 1) {
-                printf("▄");
+            if (hires) {                                                        /* 2x4 pixels per braille character */
+                uint8_t dots = 0;
+
+                for (int y = 0; y < 4; y++) {
+                    for (int x = 0; x < 2; x++) {
+                        if (priv_pixel(display, mode, c * 2 + x, r * 4 + y)) {
+                            dots |= braille_dots[y][x];
+                        }
+                    }
+                }
+                printf("\xE2%c%c", 0xA0 | (dots >> 6), 0x80 | (dots & 0x3F));
             } else {
-                printf(" ");
+                int upper = priv_pixel(display, mode, c, r * 2);
+                int lower = priv_pixel(display, mode, c, r * 2 + 1);
+
+                if (upper && lower) {
+                    printf("█");
+                } else if (upper) {
+                    printf("▀");
+                } else if (lower) {
+                    printf("▄");
+                } else {
+                    printf(" ");
+                }
             }
         }
         printf(" ║\n");
@@ -190,5 +314,14 @@ void cli_print_debug_info(chip8_t* chip8) {
     priv_display_VX_registers(chip8);
     priv_display_stack(chip8);
     priv_display_cpu(chip8);
+    if (chip8->debugger != NULL) {
+        priv_display_debugger(chip8);
+    }
+    if (chip8->runahead != NULL) {
+        priv_display_runahead(chip8);
+    }
+    if (chip8->latency != NULL) {
+        priv_display_latency(chip8);
+    }
     printf("\n");
 }
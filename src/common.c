@@ -1,4 +1,5 @@
 #include "common.h"
+#include "runahead.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,9 +12,25 @@ static const struct option long_options [] = {
     {"CLI", no_argument, 0, 'C'},
     {"GUI", no_argument, 0, 'G'},
     {"DEBUG", no_argument, 0, 'D'},
+    {"headless", no_argument, 0, 'H'},
+    {"frames", required_argument, 0, 'f'},
+    {"trace", required_argument, 0, 't'},
+    {"perf-counters", no_argument, 0, 'P'},
+    {"run-ahead", required_argument, 0, 'r'},
+    {"latency", no_argument, 0, 'L'},
+    {"input", required_argument, 0, 'I'},
+    {"watchdog", no_argument, 0, 'S'},
+    {"fusion", no_argument, 0, 'F'},
     {"ips", required_argument, 0, 'i'},
+    {"variant", required_argument, 0, 'v'},
+    {"timing", required_argument, 0, 'T'},
     {"scale", required_argument, 0, 's'},
     {"grid", no_argument, 0, 'g'},
+    {"wall", required_argument, 0, 'W'},
+    {"watch", no_argument, 0, 'w'},
+    {"keep-state", no_argument, 0, 'k'},
+    {"break", required_argument, 0, 'b'},
+    {"watch-mem", required_argument, 0, 'm'},
     {0, 0, 0, 0}
 };
 
@@ -32,16 +49,86 @@ static void priv_help() {
     printf("  -C, --CLI                Run in CLI mode.\n");
     printf("  -G, --GUI                Run in GUI mode.\n");
     printf("  -D, --DEBUG              Run in debug mode.\n");
-    printf("  -i, --ips <amount>       Number of Chip-8 instructions per seconds (default 900).\n");
+    printf("  -H, --headless           Run without display as fast as possible, then print stats.\n");
+    printf("  -i, --ips <amount>       Number of Chip-8 instructions per seconds (default 900, schip 1800, xochip 60000).\n");
+    printf("  -v, --variant <name>     chip8, schip or xochip (default from the rom extension .sc8 / .xo8, else chip8).\n");
+    printf("  -T, --timing <model>     flat (default, --ips instructions per second) or vip (COSMAC VIP cycle costs, CHIP-8 only).\n");
+    printf("  -w, --watch              Reload the rom in place when the file changes.\n");
+    printf("  -k, --keep-state         With --watch, keep registers and display across reloads.\n");
+    printf("  -t, --trace <file>       Record a binary execution trace (decode with chip8-trace).\n");
+    printf("  -P, --perf-counters      Report host cpu counters per instruction, frame and phase on exit.\n");
+    printf("  -r, --run-ahead <frames> Show the display <frames> frames ahead of the core to hide input latency (1-8, not headless).\n");
+    printf("  -L, --latency            Measure key to instruction and key to display latency, report p50/p95/p99 on exit.\n");
+    printf("\n  Headless only:\n");
+    printf("  -f, --frames <amount>    Number of 60Hz frames to run (default 3600).\n");
+    printf("  -I, --input <file>       Key script, one \"<frame> <keys>\" line per change (keys as hex digits, - for none).\n");
+    printf("  -S, --watchdog           Stop once the rom is stuck: exit status 2 halted, 3 waiting for a key, 4 repeating frames.\n");
+    printf("  -F, --fusion             Run common instruction sequences as one, report the hit rates (flat timing, no --trace).\n");
+    printf("\n  DEBUG only:\n");
+    printf("  -b, --break <addr>       Pause before executing the hex address.\n");
+    printf("  -m, --watch-mem <addr>[:r|:w]\n");
+    printf("                           Pause when FX33/FX55/FX65/DXYn reads or writes the hex address.\n");
+    printf("  Keys: p pause/continue, n step, o step over CALL, g run to next frame, b toggle breakpoint at PC.\n");
     printf("\n  GUI only:\n");
     printf("  -s, --scale <amount>     Scale the display by the specified amount (default 10).\n");
-    printf("  -g, --grid               Show grid on the display.\n\n");
+    printf("  -g, --grid               Show grid on the display.\n");
+    printf("  -W, --wall <amount>      Run <amount> instances of the rom in one window, click one to give it the keyboard.\n\n");
     printf("Miscellaneous:\n");
     printf("  -h, --help               Display this help message and exit.\n");
 
     exit(EXIT_SUCCESS);
 }
 
+static uint16_t priv_to_addr(char* input, const char* suffixes[]) {             /* suffixes: NULL terminated, "" for none */
+    char* end;
+    long res = strtol(input, &end, 16);
+    int known = FALSE;
+
+    for (int i = 0; suffixes[i] != NULL; i++) {
+        known |= strcmp(end, suffixes[i]) == 0;
+    }
+
+    if (end == input || !known || res < 0 || res > 0xFFFF) {
+        printf("%serror:%s not an address.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+static variant_t priv_to_variant(const char* input) {
+    if (strcmp(input, "chip8") == 0) return VARIANT_CHIP8;
+    if (strcmp(input, "schip") == 0) return VARIANT_SCHIP;
+    if (strcmp(input, "xochip") == 0) return VARIANT_XOCHIP;
+
+    printf("%serror:%s unknown variant, expected chip8, schip or xochip.\n", "\033[1;31m", "\033[0m");
+    exit(EXIT_FAILURE);
+}
+
+static timing_t priv_to_timing(const char* input) {
+    if (strcmp(input, "flat") == 0) return TIMING_FLAT;
+    if (strcmp(input, "vip") == 0) return TIMING_VIP;
+
+    printf("%serror:%s unknown timing, expected flat or vip.\n", "\033[1;31m", "\033[0m");
+    exit(EXIT_FAILURE);
+}
+
+static variant_t priv_variant_from_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+
+    if (ext != NULL && strcmp(ext, ".sc8") == 0) return VARIANT_SCHIP;
+    if (ext != NULL && strcmp(ext, ".xo8") == 0) return VARIANT_XOCHIP;
+    return VARIANT_CHIP8;
+}
+
+static void priv_add_point(uint16_t* points, int* nb, uint16_t addr) {
+    if (*nb >= ARGS_MAX_POINTS) {
+        printf("%serror:%s too many breakpoints / watchpoints (max %d).\n", "\033[1;31m", "\033[0m", ARGS_MAX_POINTS);
+        exit(EXIT_FAILURE);
+    }
+    points[(*nb)++] = addr;
+}
+
 static int priv_to_int(char* input) {
     int res;
     char* end;
@@ -101,8 +188,9 @@ void parse_args(int argc, char* argv [], args_t* args) {
     args->show_grid = FALSE;
     args->ips = 0;
     args->rom_path = argv[1];
+    args->variant = priv_variant_from_path(args->rom_path);
 
-    while ((opt = getopt_long(argc, argv, "hCGDi:s:g", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hCGDHf:I:SFt:PLr:i:v:T:s:gW:wkb:m:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'h':
                 priv_help();
@@ -116,15 +204,81 @@ void parse_args(int argc, char* argv [], args_t* args) {
             case 'D':
                 args->rendering_mode = DEBUG;
                 break;
+            case 'H':
+                args->rendering_mode = HEADLESS;
+                break;
+            case 'f':
+                args->frames = priv_to_int(optarg);
+                if (args->frames < 1) {                                         /* 0 is the default, negatives never stop */
+                    printf("%serror:%s frames must be at least 1.\n", "\033[1;31m", "\033[0m");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                args->trace_path = optarg;
+                break;
+            case 'P':
+                args->perf_counters = TRUE;
+                break;
+            case 'I':
+                args->input_path = optarg;
+                break;
+            case 'S':
+                args->watchdog = TRUE;
+                break;
+            case 'F':
+                args->fusion = TRUE;
+                break;
+            case 'L':
+                args->latency = TRUE;
+                break;
+            case 'r':
+                args->run_ahead = priv_to_int(optarg);
+                if (args->run_ahead < 1 || args->run_ahead > RUNAHEAD_MAX_FRAMES) {
+                    printf("%serror:%s run-ahead must be between 1 and %d frames.\n", "\033[1;31m", "\033[0m", RUNAHEAD_MAX_FRAMES);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 'i':
                 args->ips = priv_to_int(optarg);
                 break;
+            case 'v':
+                args->variant = priv_to_variant(optarg);
+                break;
+            case 'T':
+                args->timing = priv_to_timing(optarg);
+                break;
             case 's':
                 args->scale = priv_to_int(optarg);
                 break;
             case 'g':
                 args->show_grid = TRUE;
                 break;
+            case 'W':
+                args->wall = priv_to_int(optarg);
+                break;
+            case 'w':
+                args->watch = TRUE;
+                break;
+            case 'k':
+                args->keep_state = TRUE;
+                break;
+            case 'b': {
+                const char* suffixes[] = {"", NULL};
+                priv_add_point(args->breakpoints, &args->nb_breakpoints, priv_to_addr(optarg, suffixes));
+                break;
+            }
+            case 'm': {
+                const char* suffixes[] = {"", ":r", ":w", NULL};
+                uint16_t addr = priv_to_addr(optarg, suffixes);
+                const char* mode = optarg + strcspn(optarg, ":");
+
+                priv_add_point(args->watchpoints, &args->nb_watchpoints, addr);
+                args->watch_modes[args->nb_watchpoints - 1] = strcmp(mode, ":r") == 0 ? WATCH_READ
+                                                            : strcmp(mode, ":w") == 0 ? WATCH_WRITE
+                                                            : WATCH_READ | WATCH_WRITE;
+                break;
+            }
             case ':':
                 printf("option needs a value\n");
                 break;
@@ -136,4 +290,30 @@ void parse_args(int argc, char* argv [], args_t* args) {
                 break;
         }
     }
-}
\ No newline at end of file
+
+    if (args->run_ahead > 0 && args->rendering_mode == HEADLESS) {             /* nothing is presented, -H may come after -r */
+        printf("%serror:%s run-ahead needs a display, not available headless.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int read_file(const char* path, uint8_t* buffer, size_t max_len, size_t* len) {      /* non fatal, for tools and reloads */
+    FILE* file;
+    long file_len;
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return FALSE;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (file_len = ftell(file)) < 0 || (size_t)file_len > max_len) {
+        fclose(file);
+        return FALSE;
+    }
+
+    fseek(file, 0, SEEK_SET);
+    *len = fread(buffer, sizeof(uint8_t), file_len, file);
+    fclose(file);
+
+    return *len == (size_t)file_len;
+}
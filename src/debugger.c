@@ -0,0 +1,186 @@
+#include "debugger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static uint16_t priv_opcode(const chip8_t* chip8) {
+    return chip8_fetch(chip8, chip8->cpu.PC);
+}
+
+static void priv_pause(debugger_t* debugger) {                                  /* set debugger->reason first */
+    debugger->paused = TRUE;
+    debugger->stepping = FALSE;
+    debugger->run_to_frame = FALSE;
+    debugger->step_over_pc = DEBUGGER_NO_ADDR;
+}
+
+static void priv_pause_for(debugger_t* debugger, const char* reason) {
+    snprintf(debugger->reason, DEBUGGER_REASON_LEN, "%s", reason);
+    priv_pause(debugger);
+}
+
+static void priv_resume(debugger_t* debugger, const chip8_t* chip8) {
+    uint16_t pc = chip8->cpu.PC & chip8->memory_mask;
+
+    if (BIT_CHECK(debugger->breakpoints[pc >> 3], pc & 7) || debugger->nb_watchpoints > 0) {
+        debugger->skip_pc = pc;                                                 /* dont stop again on what stopped us */
+    }
+    debugger->paused = FALSE;
+    debugger->reason[0] = '\0';
+}
+
+static int priv_watch_hit(const uint8_t* bitmap, const chip8_t* chip8, uint16_t start, int len) {
+    for (int i = 0; i < len; i++) {
+        uint16_t addr = (start + i) & chip8->memory_mask;
+
+        if (BIT_CHECK(bitmap[addr >> 3], addr & 7)) {
+            return addr;
+        }
+    }
+    return -1;
+}
+
+static int priv_check_watchpoints(debugger_t* debugger, const chip8_t* chip8) {  /* memory touched by FX33, FX55, FX65, 5XY2, 5XY3 and DXYn */
+    uint16_t opcode = priv_opcode(chip8);
+    uint16_t I = chip8->cpu.I;
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    const uint8_t* bitmap;
+    const char* access;
+    int len, hit;
+
+    if ((opcode & 0xF0FF) == 0xF033) {
+        bitmap = debugger->watch_write; access = "W"; len = 3;
+    } else if ((opcode & 0xF0FF) == 0xF055) {
+        bitmap = debugger->watch_write; access = "W"; len = X + 1;
+    } else if ((opcode & 0xF0FF) == 0xF065) {
+        bitmap = debugger->watch_read; access = "R"; len = X + 1;
+    } else if ((opcode & 0xF00F) == 0x5002 && chip8->variant == VARIANT_XOCHIP) {
+        bitmap = debugger->watch_write; access = "W"; len = (X > Y ? X - Y : Y - X) + 1;
+    } else if ((opcode & 0xF00F) == 0x5003 && chip8->variant == VARIANT_XOCHIP) {
+        bitmap = debugger->watch_read; access = "R"; len = (X > Y ? X - Y : Y - X) + 1;
+    } else if ((opcode & 0xF000) == 0xD000) {                                 /* one sprite per plane drawn, back to back */
+        bitmap = debugger->watch_read; access = "R"; len = (opcode & 0xF) == 0 && chip8->ext != NULL ? 32 : opcode & 0xF;
+        len *= __builtin_popcount(chip8->planes & ((1 << chip8->display_mode.nb_planes) - 1));
+    } else {
+        return FALSE;
+    }
+
+    hit = priv_watch_hit(bitmap, chip8, I, len);
+    if (hit < 0) return FALSE;
+
+    snprintf(debugger->reason, DEBUGGER_REASON_LEN, "watch %s 0x%03X", access, hit);
+    priv_pause(debugger);
+    return TRUE;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+void debugger_init(debugger_t* debugger, const args_t* args) {
+    memset(debugger, 0, sizeof(debugger_t));
+
+    debugger->skip_pc = DEBUGGER_NO_ADDR;
+    debugger->step_over_pc = DEBUGGER_NO_ADDR;
+
+    for (int i = 0; i < args->nb_breakpoints; i++) {
+        debugger_toggle_breakpoint(debugger, args->breakpoints[i]);
+    }
+    for (int i = 0; i < args->nb_watchpoints; i++) {
+        debugger_add_watchpoint(debugger, args->watchpoints[i], args->watch_modes[i]);
+    }
+}
+
+void debugger_toggle_breakpoint(debugger_t* debugger, uint16_t addr) {
+    addr &= MEMORY_MAX_SIZE - 1;
+    debugger->breakpoints[addr >> 3] ^= 1 << (addr & 7);
+}
+
+void debugger_add_watchpoint(debugger_t* debugger, uint16_t addr, int mode) {
+    addr &= MEMORY_MAX_SIZE - 1;
+
+    if (mode & WATCH_READ) {
+        BIT_SET(debugger->watch_read[addr >> 3], addr & 7);
+    }
+    if (mode & WATCH_WRITE) {
+        BIT_SET(debugger->watch_write[addr >> 3], addr & 7);
+    }
+    debugger->nb_watchpoints++;
+}
+
+int debugger_check_slow(debugger_t* debugger, const chip8_t* chip8) {           /* see debugger_check() */
+    uint16_t pc = chip8->cpu.PC & chip8->memory_mask;
+
+    if (debugger->skip_pc == pc) {
+        debugger->skip_pc = DEBUGGER_NO_ADDR;
+        return FALSE;
+    }
+    debugger->skip_pc = DEBUGGER_NO_ADDR;
+
+    if (BIT_CHECK(debugger->breakpoints[pc >> 3], pc & 7)) {
+        snprintf(debugger->reason, DEBUGGER_REASON_LEN, "break 0x%03X", pc);
+        priv_pause(debugger);
+        return TRUE;
+    }
+
+    return debugger->nb_watchpoints > 0 && priv_check_watchpoints(debugger, chip8);
+}
+
+void debugger_after_step(debugger_t* debugger, const chip8_t* chip8) {
+    if (debugger->stepping) {
+        priv_pause_for(debugger, "step");
+    } else if (debugger->step_over_pc == chip8->cpu.PC && debugger->step_over_sp == chip8->cpu.SP) {
+        priv_pause_for(debugger, "step over");
+    }
+}
+
+void debugger_on_frame(debugger_t* debugger) {
+    if (debugger->run_to_frame && !debugger->paused) {
+        priv_pause_for(debugger, "frame");
+    }
+}
+
+int debugger_handle_key(debugger_t* debugger, const chip8_t* chip8, char key) {     /* FALSE when key is not a command */
+    uint16_t opcode = priv_opcode(chip8);
+
+    switch (key) {
+        case 'p': case 'P':                                                     /* pause / continue */
+            if (debugger->paused) {
+                priv_resume(debugger, chip8);
+            } else {
+                priv_pause_for(debugger, "user");
+            }
+            break;
+        case 'n': case 'N':                                                     /* single step */
+            priv_resume(debugger, chip8);
+            debugger->stepping = TRUE;
+            break;
+        case 'o': case 'O':                                                     /* step over CALL */
+            priv_resume(debugger, chip8);
+            if ((opcode & 0xF000) == 0x2000) {
+                debugger->step_over_pc = (chip8->cpu.PC + 2) & 0xFFFF;
+                debugger->step_over_sp = chip8->cpu.SP;
+            } else {
+                debugger->stepping = TRUE;
+            }
+            break;
+        case 'g': case 'G':                                                     /* run to next frame */
+            priv_resume(debugger, chip8);
+            debugger->run_to_frame = TRUE;
+            break;
+        case 'b': case 'B':                                                     /* toggle breakpoint at PC */
+            debugger_toggle_breakpoint(debugger, chip8->cpu.PC);
+            break;
+        default:
+            return FALSE;
+    }
+
+    return TRUE;
+}
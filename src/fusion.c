@@ -0,0 +1,157 @@
+#include "fusion.h"
+#include "analysis.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+
+static const uint8_t fusion_lengths[NB_FUSIONS] = {
+    [FUSION_SPRITE_AT] = 3,
+    [FUSION_SPRITE] = 2,
+    [FUSION_TIMER_WAIT] = 3,
+    [FUSION_INDEXED_LOAD] = 2,
+    [FUSION_COUNTER] = 2,
+};
+
+static const char* const fusion_names[NB_FUSIONS] = {
+    [FUSION_SPRITE_AT] = "6XNN 6YNN DXYn",
+    [FUSION_SPRITE] = "ANNN DXYn",
+    [FUSION_TIMER_WAIT] = "FX07 3XNN 1NNN",
+    [FUSION_INDEXED_LOAD] = "FX1E FY65",
+    [FUSION_COUNTER] = "7XNN 3XNN/4XNN",
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static fusion_kind_t priv_kind(uint16_t op1, uint16_t op2, uint16_t op3) {
+    uint8_t X1 = (op1 >> 8) & 0xF, X2 = (op2 >> 8) & 0xF;
+
+    switch (op1 >> 12) {
+        case 0x6:
+            if ((op2 >> 12) == 0x6 && (op3 >> 12) == 0xD) return FUSION_SPRITE_AT;
+            break;
+        case 0x7:
+            if (((op2 >> 12) == 0x3 || (op2 >> 12) == 0x4) && X2 == X1) return FUSION_COUNTER;
+            break;
+        case 0xA:
+            if ((op2 >> 12) == 0xD) return FUSION_SPRITE;
+            break;
+        case 0xF:
+            if ((op1 & 0xFF) == 0x07 && (op2 & 0xF000) == 0x3000 && X2 == X1 && (op3 >> 12) == 0x1) return FUSION_TIMER_WAIT;
+            if ((op1 & 0xFF) == 0x1E && (op2 & 0xF0FF) == 0xF065) return FUSION_INDEXED_LOAD;
+            break;
+        default:
+            break;
+    }
+
+    return FUSION_NONE;
+}
+
+static void priv_match(fusion_t* fusion, const chip8_t* chip8, uint16_t pc) {
+    fusion_entry_t* entry = &fusion->entries[pc & chip8->memory_mask];
+    uint16_t op1 = chip8_fetch(chip8, pc);
+    uint16_t op2 = chip8_fetch(chip8, pc + 2);
+    uint16_t op3 = chip8_fetch(chip8, pc + 4);
+
+    entry->kind = priv_kind(op1, op2, op3);
+    entry->length = fusion_lengths[entry->kind];
+    entry->X = (op1 >> 8) & 0xF;
+    entry->Y = (op2 >> 8) & 0xF;
+    entry->nn = op1 & 0xFF;
+    entry->nn2 = op2 & 0xFF;
+
+    switch (entry->kind) {
+        case FUSION_SPRITE_AT:
+        case FUSION_TIMER_WAIT:
+            entry->addr = op3 & 0x0FFF;
+            entry->last = op3;
+            break;
+        case FUSION_SPRITE:
+            entry->addr = op1 & 0x0FFF;
+            entry->last = op2;
+            break;
+        default:
+            entry->last = op2;
+            break;
+    }
+    if ((uint32_t)(pc & chip8->memory_mask) >= fusion->nb_used) {
+        fusion->nb_used = (pc & chip8->memory_mask) + 1;
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+fusion_t* fusion_open() {
+    fusion_t* fusion = calloc(1, sizeof(fusion_t));
+
+    if (fusion == NULL) {
+        printf("[ERROR] Cant allocate fusion table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return fusion;
+}
+
+void fusion_close(fusion_t* fusion) {
+    free(fusion);
+}
+
+void fusion_seed(fusion_t* fusion, const chip8_t* chip8, const analysis_t* analysis) {
+    for (uint32_t pc = ROM_START_ADR; pc < analysis->memory_size; pc++) {
+        int written = FALSE;
+
+        if (!(analysis->flags[pc] & ANALYSIS_CODE)) continue;
+
+        for (uint32_t i = pc; i < pc + FUSION_MAX_BYTES && i < analysis->memory_size; i++) {
+            written |= analysis->flags[i] & ANALYSIS_WRITTEN;
+        }
+        if (written) continue;                                                  /* self-modifying, left to the first execution */
+
+        priv_match(fusion, chip8, pc);
+        fusion->nb_seeded++;
+    }
+}
+
+void fusion_match(fusion_t* fusion, const chip8_t* chip8, uint16_t pc) {
+    priv_match(fusion, chip8, pc);
+    fusion->nb_matches++;
+}
+
+void fusion_invalidate_page(fusion_t* fusion, int index, uint16_t memory_mask) {  /* with the sequences spilling into it */
+    uint16_t start = (index << PAGE_SHIFT) - (FUSION_MAX_BYTES - 1);
+
+    for (int i = 0; i < PAGE_SIZE + FUSION_MAX_BYTES - 1; i++) {
+        fusion->entries[(uint16_t)(start + i) & memory_mask].kind = FUSION_UNKNOWN;
+    }
+}
+
+void fusion_flush(fusion_t* fusion) {                                           /* CHIP-8 roms never touch past 4 KB of the table */
+    memset(fusion->entries, 0, fusion->nb_used * sizeof(fusion_entry_t));
+    fusion->nb_used = 0;
+}
+
+void fusion_print(const fusion_t* fusion, uint64_t nb_instructions) {
+    uint64_t sequences = 0, fused = 0;
+
+    for (int i = FUSION_SPRITE_AT; i < NB_FUSIONS; i++) {
+        sequences += fusion->sequences[i];
+        fused += fusion->instructions[i];
+    }
+
+    printf("fusion:        %.1f%% of instructions in %" PRIu64 " sequences, %" PRIu64 " addresses matched from the analysis, %" PRIu64 " at run time, %" PRIu64 " invalidated\n",
+           nb_instructions > 0 ? 100.0 * fused / nb_instructions : 0.0, sequences, fusion->nb_seeded, fusion->nb_matches, fusion->nb_invalidations);
+    for (int i = FUSION_SPRITE_AT; i < NB_FUSIONS; i++) {
+        printf("  %-16s %10" PRIu64 " sequences %10" PRIu64 " instructions  %5.1f%%\n", fusion_names[i],
+               fusion->sequences[i], fusion->instructions[i], nb_instructions > 0 ? 100.0 * fusion->instructions[i] / nb_instructions : 0.0);
+    }
+    printf("  %-16s %10" PRIu64 " instructions of timer waits skipped, not counted above\n", "idle", fusion->nb_idle);
+}
@@ -1,9 +1,14 @@
 #include "gui.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define NB_KEYS 16
+#define WALL_MAX_WIDTH   1920
+#define WALL_MAX_HEIGHT  1080
+#define WALL_BORDER      2
+#define WALL_FPS         60
 
 
 /******************************************************
@@ -18,15 +23,53 @@ static const char keys[NB_KEYS] = {
 };
 
 
+static void priv_poll_keys(uint16_t* keys_state) {
+    for (size_t i = 0; i < 16; i++) {
+        uint8_t key = keys[i];
+
+        if (IsKeyDown(key)) {
+            BIT_SET(*keys_state, get_key(key));
+        } else {
+            BIT_CLEAR(*keys_state, get_key(key));
+        }
+    }
+}
+
+static const uint8_t palette[1 << DISPLAY_MAX_PLANES][3] = {                   /* indexed by the plane bits of a pixel */
+    { 24, 24, 37 },
+    { 205, 214, 244 },
+    { 243, 139, 168 },
+    { 249, 226, 175 },
+};
+
+static void priv_set_pixels(uint8_t* buffer, int stride, const uint64_t* display, display_mode_t mode) {    /* stride in pixels */
+    size_t words = DISPLAY_ROW_WORDS(mode);
+
+    for (size_t y = 0; y < mode.height; ++y) {
+        uint8_t* pixel = buffer + y * stride * 3;
+
+        for (size_t x = 0; x < mode.width; ++x, pixel += 3) {
+            const uint64_t* word = display + y * words + x / 64;
+            int color = 0;
+
+            for (int p = 0; p < mode.nb_planes; p++, word += DISPLAY_PLANE_WORDS(mode)) {
+                color |= DISPLAY_PIXEL(*word, x % 64) << p;
+            }
+            memcpy(pixel, palette[color], 3);
+        }
+    }
+}
+
 static void priv_draw_grid(gui_t* gui) {
-    int scale = gui->scale;
+    int width = gui->source.width, height = gui->source.height;
+    float cell = gui->dest.width / width;
     Color color = (Color){ 24, 24, 37, 255 };
 
-    for (size_t i = 0; i < CHIP8_DISPLAY_WIDTH; i++) {
-        DrawLine(i * scale, 0, i * scale, CHIP8_DISPLAY_HEIGHT * scale, color);
+    for (int i = 0; i < width; i++) {
+        DrawLine(i * cell, 0, i * cell, gui->dest.height, color);
     }
-    for (size_t i = 0; i < CHIP8_DISPLAY_HEIGHT; i++) {
-        DrawLine(0, i * scale, CHIP8_DISPLAY_WIDTH * scale, i * scale, color);
+    for (int i = 0; i < height; i++) {
+        DrawLine(0, i * cell, gui->dest.width, i * cell, color);
     }
 }
 
@@ -43,12 +86,12 @@ void gui_init(gui_t* gui, const char* title, int scale, int show_grid) {
     InitWindow(CHIP8_DISPLAY_WIDTH * scale, CHIP8_DISPLAY_HEIGHT * scale, title);
     SetExitKey(KEY_ESCAPE);
 
-    memset(gui->buffer, 0, sizeof(uint8_t) * CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT * 3);
+    memset(gui->buffer, 0, sizeof(gui->buffer));
 
     img = (Image){
         .data = gui->buffer,
-        .width = CHIP8_DISPLAY_WIDTH,
-        .height = CHIP8_DISPLAY_HEIGHT,
+        .width = DISPLAY_MAX_WIDTH,
+        .height = DISPLAY_MAX_HEIGHT,
         .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
         .mipmaps = 1,
     };
@@ -80,32 +123,15 @@ void gui_quit() {
 
 void gui_poll_events(gui_t* gui, uint16_t* keys_state) {
     gui->running = !WindowShouldClose();
-
-    for (size_t i = 0; i < 16; i++) {
-        uint8_t key = keys[i];
-
-        if (IsKeyDown(key)) {
-            BIT_SET(*keys_state, get_key(key));
-        } else {
-            BIT_CLEAR(*keys_state, get_key(key));
-        }
-    }
+    priv_poll_keys(keys_state);
 }
 
-void gui_set_buffer(gui_t* gui, uint8_t* buffer) {
-    for (size_t i = 0; i < CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT; ++i) {
-        if (buffer[i] == 1) {
-            gui->buffer[i * 3 + 0] = 205;
-            gui->buffer[i * 3 + 1] = 214;
-            gui->buffer[i * 3 + 2] = 244;
-        } else {
-            gui->buffer[i * 3 + 0] = 24;
-            gui->buffer[i * 3 + 1] = 24;
-            gui->buffer[i * 3 + 2] = 37;
-        }
-    }
-
+void gui_set_buffer(gui_t* gui, const uint64_t* display, display_mode_t mode) {
+    priv_set_pixels(gui->buffer, DISPLAY_MAX_WIDTH, display, mode);
     UpdateTexture(gui->texture, gui->buffer);
+
+    gui->source.width = mode.width;                                             /* hires pixels are half the size on screen */
+    gui->source.height = mode.height;
 }
 
 void gui_render(gui_t* gui) {
@@ -116,4 +142,122 @@ void gui_render(gui_t* gui) {
         priv_draw_grid(gui);
     }
     EndDrawing();
-}
\ No newline at end of file
+}
+
+void gui_wall_init(gui_wall_t* wall, const char* title, int nb_tiles, int scale) {
+    int width, height;
+    Image img;
+
+    wall->nb_tiles = nb_tiles;
+    wall->cols = 1;
+    while (wall->cols * wall->cols < nb_tiles) {
+        wall->cols++;
+    }
+    wall->rows = (nb_tiles + wall->cols - 1) / wall->cols;
+
+    width = wall->cols * CHIP8_DISPLAY_WIDTH;
+    height = wall->rows * CHIP8_DISPLAY_HEIGHT;
+    while (scale > 1 && (width * scale > WALL_MAX_WIDTH || height * scale > WALL_MAX_HEIGHT)) {
+        scale--;
+    }
+
+    wall->buffer = calloc(width * height * 3, sizeof(uint8_t));
+    if (wall->buffer == NULL) {
+        printf("[ERROR] Cant allocate wall atlas\n");
+        exit(EXIT_FAILURE);
+    }
+
+    SetTraceLogLevel(LOG_ERROR);
+
+    InitWindow(width * scale, height * scale, title);
+    SetExitKey(KEY_ESCAPE);
+    SetTargetFPS(WALL_FPS);
+
+    img = (Image){
+        .data = wall->buffer,
+        .width = width,
+        .height = height,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+        .mipmaps = 1,
+    };
+    wall->texture = LoadTextureFromImage(img);
+
+    wall->source = (Rectangle){ .x = 0, .y = 0, .width = width, .height = height };
+    wall->dest = (Rectangle){ .x = 0, .y = 0, .width = width * scale, .height = height * scale };
+
+    wall->scale = scale;
+    wall->focus = 0;
+    wall->dirty_first = 0;
+    wall->dirty_last = wall->rows - 1;
+    wall->running = TRUE;
+}
+
+void gui_wall_quit(gui_wall_t* wall) {
+    UnloadTexture(wall->texture);
+    CloseWindow();
+    free(wall->buffer);
+}
+
+void gui_wall_poll_events(gui_wall_t* wall, uint16_t* keys_state) {           /* keys_state of the focused tile */
+    wall->running = !WindowShouldClose();
+
+    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+        Vector2 mouse = GetMousePosition();
+        int col = mouse.x / (CHIP8_DISPLAY_WIDTH * wall->scale);
+        int row = mouse.y / (CHIP8_DISPLAY_HEIGHT * wall->scale);
+        int index = row * wall->cols + col;
+
+        if (col >= 0 && col < wall->cols && row >= 0 && index < wall->nb_tiles) {
+            wall->focus = index;
+        }
+    }
+
+    priv_poll_keys(keys_state);
+}
+
+void gui_wall_set_tile(gui_wall_t* wall, int index, const uint64_t* display) {   /* cpu side only, see gui_wall_render() */
+    display_mode_t mode = { CHIP8_DISPLAY_WIDTH, CHIP8_DISPLAY_HEIGHT, 1 };     /* CHIP-8 tiles only */
+    int col = index % wall->cols;
+    int row = index / wall->cols;
+    int stride = wall->cols * CHIP8_DISPLAY_WIDTH;
+
+    priv_set_pixels(wall->buffer + (row * CHIP8_DISPLAY_HEIGHT * stride + col * CHIP8_DISPLAY_WIDTH) * 3, stride, display, mode);
+
+    if (wall->dirty_first > wall->dirty_last) {
+        wall->dirty_first = wall->dirty_last = row;
+    } else if (row < wall->dirty_first) {
+        wall->dirty_first = row;
+    } else if (row > wall->dirty_last) {
+        wall->dirty_last = row;
+    }
+}
+
+void gui_wall_render(gui_wall_t* wall) {                                        /* at most one upload and one textured draw, whatever the tile count */
+    int stride = wall->cols * CHIP8_DISPLAY_WIDTH;
+    int focus_col = wall->focus % wall->cols;
+    int focus_row = wall->focus / wall->cols;
+
+    if (wall->dirty_first <= wall->dirty_last) {                                /* the dirty tile rows are contiguous in the atlas */
+        Rectangle rows = {
+            .x = 0,
+            .y = wall->dirty_first * CHIP8_DISPLAY_HEIGHT,
+            .width = stride,
+            .height = (wall->dirty_last - wall->dirty_first + 1) * CHIP8_DISPLAY_HEIGHT,
+        };
+
+        UpdateTextureRec(wall->texture, rows, wall->buffer + (size_t)rows.y * stride * 3);
+        wall->dirty_first = wall->rows;
+        wall->dirty_last = -1;
+    }
+
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawTexturePro(wall->texture, wall->source, wall->dest, (Vector2) { 0, 0 }, 0.0f, WHITE);
+    DrawRectangleLinesEx((Rectangle){
+        .x = focus_col * CHIP8_DISPLAY_WIDTH * wall->scale,
+        .y = focus_row * CHIP8_DISPLAY_HEIGHT * wall->scale,
+        .width = CHIP8_DISPLAY_WIDTH * wall->scale,
+        .height = CHIP8_DISPLAY_HEIGHT * wall->scale,
+    }, WALL_BORDER, RED);
+    EndDrawing();
+}
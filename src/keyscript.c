@@ -0,0 +1,119 @@
+#include "keyscript.h"
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+
+typedef struct keyscript_entry {
+    uint64_t frame;
+    uint16_t keys;
+} keyscript_entry_t;
+
+struct keyscript {
+    keyscript_entry_t* entries;
+    size_t nb_entries, capacity;
+    size_t next;                            /* first entry not applied yet */
+    uint16_t keys;
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_syntax_error(const char* path, int line) {
+    printf("[ERROR] Bad key script line %d: %s\n", line, path);
+    exit(EXIT_FAILURE);
+}
+
+static void priv_add(keyscript_t* script, uint64_t frame, uint16_t keys) {
+    if (script->nb_entries == script->capacity) {
+        script->capacity = script->capacity == 0 ? 64 : script->capacity * 2;
+        script->entries = realloc(script->entries, script->capacity * sizeof(keyscript_entry_t));
+        if (script->entries == NULL) {
+            printf("[ERROR] Cant allocate key script\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    script->entries[script->nb_entries].frame = frame;
+    script->entries[script->nb_entries].keys = keys;
+    script->nb_entries++;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+keyscript_t* keyscript_load(const char* path) {
+    char buffer[256];
+    keyscript_t* script;
+    FILE* file;
+    int line = 0;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        printf("[ERROR] Cant open key script: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    script = calloc(1, sizeof(keyscript_t));
+    if (script == NULL) {
+        printf("[ERROR] Cant allocate key script\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        char* ptr = strchr(buffer, '#');
+        uint16_t keys = 0;
+        uint64_t frame;
+        char* end;
+
+        line++;
+        if (ptr != NULL) *ptr = '\0';
+        for (ptr = buffer; isspace((unsigned char)*ptr); ptr++);
+        if (*ptr == '\0') continue;
+
+        frame = strtoull(ptr, &end, 10);
+        if (end == ptr || !isspace((unsigned char)*end)) priv_syntax_error(path, line);
+        if (script->nb_entries > 0 && frame <= script->entries[script->nb_entries - 1].frame) priv_syntax_error(path, line);
+
+        for (ptr = end; isspace((unsigned char)*ptr); ptr++);
+        if (*ptr == '-') {
+            ptr++;
+        } else {
+            for (; isxdigit((unsigned char)*ptr); ptr++) {
+                BIT_SET(keys, isdigit((unsigned char)*ptr) ? *ptr - '0' : tolower((unsigned char)*ptr) - 'a' + 10);
+            }
+        }
+        for (; isspace((unsigned char)*ptr); ptr++);
+        if (*ptr != '\0') priv_syntax_error(path, line);
+
+        priv_add(script, frame, keys);
+    }
+    fclose(file);
+
+    return script;
+}
+
+void keyscript_free(keyscript_t* script) {
+    free(script->entries);
+    free(script);
+}
+
+uint16_t keyscript_keys(keyscript_t* script, uint64_t frame) {
+    while (script->next < script->nb_entries && script->entries[script->next].frame <= frame) {
+        script->keys = script->entries[script->next].keys;
+        script->next++;
+    }
+
+    return script->keys;
+}
+
+int keyscript_done(const keyscript_t* script) {
+    return script->next == script->nb_entries;
+}
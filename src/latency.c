@@ -0,0 +1,154 @@
+#include "latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+
+#define LATENCY_BUCKET_MS  0.25
+#define LATENCY_NB_BUCKETS 4000              /* one second, slower samples land in the last bucket */
+
+
+typedef enum {
+    EDGE_NONE = 0,
+    EDGE_PENDING,                           /* waiting for an instruction to read the key */
+    EDGE_CONSUMED,                          /* waiting for the display to change */
+} edge_state_t;
+
+struct latency {
+    int emulated;
+    uint64_t frame_instructions;            /* nb_instructions when the current frame started */
+
+    edge_state_t state[16];
+    double edge_time[16];
+
+    uint64_t nb_edges;
+    uint64_t counts[LATENCY_NB_KINDS];
+    double max[LATENCY_NB_KINDS];
+    uint32_t buckets[LATENCY_NB_KINDS][LATENCY_NB_BUCKETS];
+};
+
+
+static const char* kind_names[LATENCY_NB_KINDS] = { "consume", "present" };
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static double priv_now(const latency_t* latency, const chip8_t* chip8) {       /* seconds */
+    struct timespec now;
+
+    if (latency->emulated) {
+        return (double)chip8->nb_frames / UPDATE_RATE_60HZ + (double)(chip8->nb_instructions - latency->frame_instructions) / chip8->ips;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+}
+
+static void priv_record(latency_t* latency, latency_kind_t kind, double seconds) {
+    double ms = seconds * 1000.0;
+    int bucket = ms / LATENCY_BUCKET_MS;
+
+    if (bucket < 0) bucket = 0;
+    if (bucket >= LATENCY_NB_BUCKETS) bucket = LATENCY_NB_BUCKETS - 1;
+
+    latency->buckets[kind][bucket]++;
+    latency->counts[kind]++;
+    if (ms > latency->max[kind]) {
+        latency->max[kind] = ms;
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+latency_t* latency_open(int emulated) {
+    latency_t* latency;
+
+    latency = calloc(1, sizeof(latency_t));
+    if (latency == NULL) {
+        printf("[ERROR] Cant allocate latency stats\n");
+        exit(EXIT_FAILURE);
+    }
+    latency->emulated = emulated;
+
+    return latency;
+}
+
+void latency_close(latency_t* latency) {
+    free(latency);
+}
+
+void latency_keys(latency_t* latency, const chip8_t* chip8, uint16_t previous, uint16_t keys) {
+    uint16_t edges = previous ^ keys;
+    double now;
+
+    if (edges == 0) return;
+
+    now = priv_now(latency, chip8);
+    for (int i = 0; i < 16; i++) {
+        if (BIT_CHECK(edges, i)) {                                              /* an edge nobody read yet is replaced */
+            latency->state[i] = EDGE_PENDING;
+            latency->edge_time[i] = now;
+            latency->nb_edges++;
+        }
+    }
+}
+
+void latency_consume(latency_t* latency, const chip8_t* chip8, uint8_t key) {
+    key &= 0xF;
+    if (latency->state[key] != EDGE_PENDING) return;
+
+    priv_record(latency, LATENCY_CONSUME, priv_now(latency, chip8) - latency->edge_time[key]);
+    latency->state[key] = EDGE_CONSUMED;
+}
+
+void latency_present(latency_t* latency, const chip8_t* chip8, int changed) {
+    latency->frame_instructions = chip8->nb_instructions;
+
+    if (changed) {
+        double now = priv_now(latency, chip8);
+
+        for (int i = 0; i < 16; i++) {
+            if (latency->state[i] == EDGE_CONSUMED) {
+                priv_record(latency, LATENCY_PRESENT, now - latency->edge_time[i]);
+                latency->state[i] = EDGE_NONE;
+            }
+        }
+    }
+}
+
+uint64_t latency_count(const latency_t* latency, latency_kind_t kind) {
+    return latency->counts[kind];
+}
+
+double latency_percentile(const latency_t* latency, latency_kind_t kind, double percent) {
+    double rank = latency->counts[kind] * percent / 100.0;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LATENCY_NB_BUCKETS; i++) {
+        seen += latency->buckets[kind][i];
+        if (seen > 0 && seen >= rank) {
+            double upper = (i + 1) * LATENCY_BUCKET_MS;                         /* upper bound of the bucket */
+            return upper < latency->max[kind] ? upper : latency->max[kind];
+        }
+    }
+
+    return latency->max[kind];
+}
+
+void latency_print(const latency_t* latency) {
+    printf("\ninput latency, %" PRIu64 " key edges, %s time\n", latency->nb_edges, latency->emulated ? "emulated" : "host");
+    printf("  %-10s %8s %9s %9s %9s %9s\n", "", "samples", "p50 ms", "p95 ms", "p99 ms", "max ms");
+
+    for (int k = 0; k < LATENCY_NB_KINDS; k++) {
+        printf("  %-10s %8" PRIu64 " %9.2f %9.2f %9.2f %9.2f\n", kind_names[k], latency->counts[k],
+               latency_percentile(latency, k, 50), latency_percentile(latency, k, 95),
+               latency_percentile(latency, k, 99), latency->max[k]);
+    }
+}
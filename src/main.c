@@ -4,17 +4,29 @@
 
 #include "common.h"
 #include "chip8.h"
+#include "wall.h"
+#include "watchdog.h"
 
 
 int main(int argc, char* argv []) {
     chip8_t* chip8;
     args_t args = { 0 };
+    int status;
 
     parse_args(argc, argv, &args);
 
-    chip8 = chip8_init(args.rom_path, args.rendering_mode, args.scale, args.show_grid, args.ips);
+    if (args.wall > 0) {
+        wall_t* wall = wall_init(&args);
+
+        wall_main_loop(wall);
+        wall_quit(wall);
+        exit(EXIT_SUCCESS);
+    }
+
+    chip8 = chip8_init(&args);
     chip8_main_loop(chip8);
+    status = chip8->watchdog != NULL ? watchdog_exit_status(chip8->watchdog) : EXIT_SUCCESS;
     chip8_quit(chip8);
 
-    exit(EXIT_SUCCESS);
+    exit(status);
 }
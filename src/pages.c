@@ -0,0 +1,255 @@
+#include "pages.h"
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define PAGES_PER_SLAB  1024
+
+
+static page_t zero_page = { .refs = 1 };                                        /* static pages keep a reference forever */
+
+static page_t font_page = { .refs = 1, .data = {
+    [FONT_START_ADR] =
+    0xF0, 0x90, 0x90, 0x90, 0xF0,       /* 0 */
+    0x20, 0x60, 0x20, 0x20, 0x70,       /* 1 */
+    0xF0, 0x10, 0xF0, 0x80, 0xF0,       /* 2 */
+    0xF0, 0x10, 0xF0, 0x10, 0xF0,       /* 3 */
+    0x90, 0x90, 0xF0, 0x10, 0x10,       /* 4 */
+    0xF0, 0x80, 0xF0, 0x10, 0xF0,       /* 5 */
+    0xF0, 0x80, 0xF0, 0x90, 0xF0,       /* 6 */
+    0xF0, 0x10, 0x20, 0x40, 0x40,       /* 7 */
+    0xF0, 0x90, 0xF0, 0x90, 0xF0,       /* 8 */
+    0xF0, 0x90, 0xF0, 0x10, 0xF0,       /* 9 */
+    0xF0, 0x90, 0xF0, 0x90, 0x90,       /* A */
+    0xE0, 0x90, 0xE0, 0x90, 0xE0,       /* B */
+    0xF0, 0x80, 0x80, 0x80, 0xF0,       /* C */
+    0xE0, 0x90, 0x90, 0x90, 0xE0,       /* D */
+    0xF0, 0x80, 0xF0, 0x80, 0xF0,       /* E */
+    0xF0, 0x80, 0xF0, 0x80, 0x80        /* F */
+} };
+
+static page_t big_font_page = { .refs = 1, .data = {                           /* mapped at BIG_FONT_START_ADR */
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,     /* 0 */
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,     /* 1 */
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,     /* 2 */
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     /* 3 */
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,     /* 4 */
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     /* 5 */
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,     /* 6 */
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,     /* 7 */
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,     /* 8 */
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     /* 9 */
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,     /* A */
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,     /* B */
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,     /* C */
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,     /* D */
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,     /* E */
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0      /* F */
+} };
+
+static pool_t page_pool = POOL_INITIALIZER(sizeof(page_t), PAGES_PER_SLAB);
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static page_t* priv_share(const uint8_t* data) {                                /* static page with the same content, or a new one */
+    page_t* page;
+
+    if (memcmp(data, zero_page.data, PAGE_SIZE) == 0) {
+        page = &zero_page;
+    } else if (memcmp(data, font_page.data, PAGE_SIZE) == 0) {
+        page = &font_page;
+    } else {
+        page = pool_alloc(&page_pool);
+        page->refs = 0;
+        memcpy(page->data, data, PAGE_SIZE);
+    }
+
+    page_retain(page);
+    return page;
+}
+
+static int priv_is_static(const page_t* page) {
+    return page == &zero_page || page == &font_page || page == &big_font_page;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+void page_release(page_t* page) {
+    if (__atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        pool_free(&page_pool, page);
+    }
+}
+
+void page_make_private(page_t** slot) {                                         /* copy on write */
+    page_t* page = *slot;
+    page_t* copy;
+
+    if (__atomic_load_n(&page->refs, __ATOMIC_ACQUIRE) == 1) return;          /* last user, no copy */
+
+    copy = pool_alloc(&page_pool);
+    copy->refs = 1;
+    memcpy(copy->data, page->data, PAGE_SIZE);
+
+    page_release(page);
+    *slot = copy;
+}
+
+page_t* page_zero() {
+    return &zero_page;
+}
+
+page_t* page_big_font() {
+    return &big_font_page;
+}
+
+rom_t* rom_create(const uint8_t* data, size_t len) {
+    uint8_t image[NB_PAGES * PAGE_SIZE];                                        /* the first 4 KB, beyond that pages are built in place */
+    rom_t* rom;
+
+    if (len > MEMORY_MAX_SIZE - ROM_START_ADR) {
+        return NULL;
+    }
+
+    rom = malloc(sizeof(rom_t));
+    if (rom == NULL) {
+        printf("[ERROR] Cant allocate rom memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(image, 0, sizeof(image));
+    memcpy(image + FONT_START_ADR, font_page.data + FONT_START_ADR, FONT_SIZE);
+    memcpy(image + ROM_START_ADR, data, len < sizeof(image) - ROM_START_ADR ? len : sizeof(image) - ROM_START_ADR);
+
+    for (int i = 0; i < NB_PAGES; i++) {
+        rom->pages[i] = priv_share(image + i * PAGE_SIZE);
+    }
+    rom->nb_pages = len > sizeof(image) - ROM_START_ADR ? NB_MAX_PAGES : NB_PAGES;
+    for (int i = NB_PAGES; i < rom->nb_pages; i++) {                            /* XO-CHIP roms larger than 4 KB */
+        size_t start = i * PAGE_SIZE - ROM_START_ADR;
+
+        if (start >= len) {
+            rom->pages[i] = &zero_page;
+            page_retain(&zero_page);
+        } else if (len - start >= PAGE_SIZE) {
+            rom->pages[i] = priv_share(data + start);
+        } else {
+            uint8_t tail[PAGE_SIZE] = { 0 };
+
+            memcpy(tail, data + start, len - start);
+            rom->pages[i] = priv_share(tail);
+        }
+    }
+    rom->refs = 1;
+    rom->len = len;
+
+    return rom;
+}
+
+int rom_refill(rom_t* rom, const uint8_t* data, size_t len) {                   /* see pages.h */
+    int nb_pages = len > MEMORY_SIZE - ROM_START_ADR ? NB_MAX_PAGES : NB_PAGES;
+
+    if (len > MEMORY_MAX_SIZE - ROM_START_ADR) {
+        return FALSE;
+    }
+
+    for (int i = rom->nb_pages; i < nb_pages; i++) {                            /* grows, never shrinks: no allocation once warm */
+        rom->pages[i] = &zero_page;
+        page_retain(&zero_page);
+    }
+    if (nb_pages > rom->nb_pages) {
+        rom->nb_pages = nb_pages;
+    }
+
+    for (int i = ROM_START_ADR >> PAGE_SHIFT; i < rom->nb_pages; i++) {
+        size_t start = i * PAGE_SIZE - ROM_START_ADR;
+        size_t n = start >= len ? 0 : len - start > PAGE_SIZE ? PAGE_SIZE : len - start;
+        page_t* page = rom->pages[i];
+
+        if (priv_is_static(page)) {
+            if (n == 0 && page == &zero_page) continue;
+
+            page_release(page);                                                 /* static, never freed */
+            page = pool_alloc(&page_pool);
+            page->refs = 1;
+            rom->pages[i] = page;
+        }
+        memcpy(page->data, data + start, n);
+        memset(page->data + n, 0, PAGE_SIZE - n);
+    }
+    rom->len = len;
+
+    return TRUE;
+}
+
+rom_t* rom_load(const char* path) {
+    uint8_t* buffer;
+    FILE* file;
+    size_t file_len;
+    rom_t* rom;
+
+    file = fopen(path, "rb");                                               /* open file */
+    if (file == NULL) {
+        printf("[ERROR] Cant open rom file: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0) {                                    /* go to end of file */
+        printf("[ERROR] fseek failed\n");
+        fclose(file);
+        exit(EXIT_FAILURE);
+    }
+
+    file_len = ftell(file);                                                 /* len = delta between start - end */
+    if (file_len > MEMORY_MAX_SIZE - ROM_START_ADR) {
+        printf("[ERROR] rom to large\n");
+        fclose(file);
+        exit(EXIT_FAILURE);
+    }
+
+    fseek(file, 0, SEEK_SET);                                               /* go back to start */
+
+    buffer = malloc(file_len + 1);
+    if (buffer == NULL) {
+        printf("[ERROR] Cant allocate rom memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(buffer, sizeof(uint8_t), file_len, file) != file_len) {   /* read entire file */
+        printf("[ERROR] fread failed for file: %s\n", path);
+        fclose(file);
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(file);                                                           /* close file */
+
+    rom = rom_create(buffer, file_len);
+    free(buffer);
+
+    return rom;
+}
+
+void rom_retain(rom_t* rom) {
+    __atomic_add_fetch(&rom->refs, 1, __ATOMIC_RELAXED);
+}
+
+void rom_release(rom_t* rom) {
+    if (__atomic_sub_fetch(&rom->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+
+    for (int i = 0; i < rom->nb_pages; i++) {
+        page_release(rom->pages[i]);
+    }
+    free(rom);
+}
+
+size_t pages_used() {
+    return pool_used(&page_pool);
+}
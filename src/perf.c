@@ -0,0 +1,198 @@
+#include "perf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+struct perf {
+    int fds[PERF_NB_COUNTERS];              /* -1 when the host does not support the counter */
+    int group_index[PERF_NB_COUNTERS];      /* position in the group read */
+    int nb_open;
+
+    perf_phase_t phase;
+    uint64_t last[PERF_NB_COUNTERS];
+    uint64_t totals[PERF_NB_PHASES][PERF_NB_COUNTERS];
+};
+
+typedef struct perf_event {
+    uint32_t type;
+    uint64_t config;
+    const char* name;
+} perf_event_t;
+
+
+static const perf_event_t events[PERF_NB_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-miss" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "L1D-miss" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "LLC-miss" },
+};
+
+static const char* phase_names[PERF_NB_PHASES] = { "other", "cpu", "timers", "render", "input" };
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static int priv_open_event(const perf_event_t* event, int group_fd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.disabled = group_fd == -1;                                             /* the leader starts the whole group */
+    attr.exclude_kernel = 1;                                                    /* allowed up to perf_event_paranoid 2 */
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void priv_read(perf_t* perf, uint64_t* values) {                        /* scaled when the counters were multiplexed */
+    uint64_t buffer[3 + PERF_NB_COUNTERS];
+    double scale = 1.0;
+
+    memset(values, 0, PERF_NB_COUNTERS * sizeof(uint64_t));
+    if (read(perf->fds[PERF_CYCLES], buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+
+    if (buffer[2] > 0 && buffer[2] < buffer[1]) {
+        scale = (double)buffer[1] / buffer[2];
+    }
+    for (int i = 0; i < PERF_NB_COUNTERS; i++) {
+        if (perf->fds[i] >= 0) {
+            values[i] = buffer[3 + perf->group_index[i]] * scale;
+        }
+    }
+}
+
+static void priv_unavailable_warning(int error) {
+    FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    int level;
+
+    if (file != NULL && fscanf(file, "%d", &level) == 1 && level > 2) {
+        printf("[WARNING] perf counters unavailable (perf_event_paranoid is %d, needs 2 or less), running without them\n", level);
+    } else {
+        printf("[WARNING] perf counters unavailable (%s), running without them\n", strerror(error));
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+static void priv_print_row(const perf_t* perf, const char* name, const uint64_t* values, double divisor) {
+    printf("  %-18s", name);
+    for (int i = 0; i < PERF_NB_COUNTERS; i++) {
+        if (perf->fds[i] < 0) {
+            printf(" %14s", "n/a");
+        } else if (divisor == 1.0) {
+            printf(" %14" PRIu64, values[i]);
+        } else {
+            printf(" %14.2f", divisor > 0 ? values[i] / divisor : 0.0);
+        }
+    }
+    printf("\n");
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+perf_t* perf_open() {
+    perf_t* perf;
+
+    perf = calloc(1, sizeof(perf_t));
+    if (perf == NULL) {
+        printf("[ERROR] Cant allocate perf counters\n");
+        exit(EXIT_FAILURE);
+    }
+
+    perf->fds[PERF_CYCLES] = priv_open_event(&events[PERF_CYCLES], -1);
+    if (perf->fds[PERF_CYCLES] < 0) {                                           /* containers, paranoid hosts, no PMU */
+        priv_unavailable_warning(errno);
+        free(perf);
+        return NULL;
+    }
+    perf->nb_open = 1;
+
+    for (int i = 1; i < PERF_NB_COUNTERS; i++) {                                /* VMs often lack the cache events */
+        perf->fds[i] = priv_open_event(&events[i], perf->fds[PERF_CYCLES]);
+        if (perf->fds[i] >= 0) {
+            perf->group_index[i] = perf->nb_open++;
+        }
+    }
+
+    ioctl(perf->fds[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf->fds[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    priv_read(perf, perf->last);
+
+    return perf;
+}
+
+void perf_close(perf_t* perf) {
+    for (int i = PERF_NB_COUNTERS - 1; i >= 0; i--) {
+        if (perf->fds[i] >= 0) {
+            close(perf->fds[i]);
+        }
+    }
+    free(perf);
+}
+
+perf_phase_t perf_phase(perf_t* perf, perf_phase_t phase) {
+    perf_phase_t previous = perf->phase;
+    uint64_t now[PERF_NB_COUNTERS];
+
+    if (phase == previous) return previous;
+
+    priv_read(perf, now);
+    for (int i = 0; i < PERF_NB_COUNTERS; i++) {
+        perf->totals[previous][i] += now[i] - perf->last[i];
+        perf->last[i] = now[i];
+    }
+    perf->phase = phase;
+
+    return previous;
+}
+
+void perf_print(perf_t* perf, uint64_t nb_instructions, uint64_t nb_frames) {
+    uint64_t total[PERF_NB_COUNTERS] = { 0 };
+
+    perf_phase(perf, PERF_OTHER);                                               /* flush the running phase */
+
+    for (int p = 0; p < PERF_NB_PHASES; p++) {
+        for (int i = 0; i < PERF_NB_COUNTERS; i++) {
+            total[i] += perf->totals[p][i];
+        }
+    }
+
+    printf("\nhost counters, user space only\n  %-18s", "");
+    for (int i = 0; i < PERF_NB_COUNTERS; i++) {
+        printf(" %14s", events[i].name);
+    }
+    printf("\n");
+
+    priv_print_row(perf, "total", total, 1.0);
+    priv_print_row(perf, "per instruction", total, nb_instructions);
+    priv_print_row(perf, "per frame", total, nb_frames);
+    priv_print_row(perf, "cpu / instruction", perf->totals[PERF_CPU], nb_instructions);
+
+    printf("  by phase:\n");
+    for (int p = 0; p < PERF_NB_PHASES; p++) {
+        char name[32];
+
+        if (perf->totals[p][PERF_CYCLES] == 0 && perf->totals[p][PERF_INSTRUCTIONS] == 0) continue;
+
+        snprintf(name, sizeof(name), "  %-7s %5.1f%%", phase_names[p], total[PERF_CYCLES] > 0 ? 100.0 * perf->totals[p][PERF_CYCLES] / total[PERF_CYCLES] : 0.0);
+        priv_print_row(perf, name, perf->totals[p], 1.0);
+    }
+}
@@ -0,0 +1,84 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_grow(pool_t* pool) {                                           /* lock held */
+    size_t block_size = (pool->block_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    void** slabs;
+    char* slab;
+
+    slab = malloc(block_size * pool->blocks_per_slab);
+    slabs = realloc(pool->slabs, (pool->nb_slabs + 1) * sizeof(void*));
+    if (slab == NULL || slabs == NULL) {
+        printf("[ERROR] Cant allocate pool slab\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->slabs = slabs;
+    pool->slabs[pool->nb_slabs++] = slab;
+
+    for (size_t i = pool->blocks_per_slab; i-- > 0; ) {                        /* thread the free list in address order */
+        void** block = (void**)(slab + i * block_size);
+
+        *block = pool->free_list;
+        pool->free_list = block;
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+void* pool_alloc(pool_t* pool) {
+    void** block;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_list == NULL) {
+        priv_grow(pool);
+    }
+    block = pool->free_list;
+    pool->free_list = *block;
+    pool->nb_used++;
+    pthread_mutex_unlock(&pool->lock);
+
+    return block;
+}
+
+void pool_free(pool_t* pool, void* block) {
+    pthread_mutex_lock(&pool->lock);
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+    pool->nb_used--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(pool_t* pool) {                                               /* every block is released at once */
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < pool->nb_slabs; i++) {
+        free(pool->slabs[i]);
+    }
+    free(pool->slabs);
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->nb_slabs = 0;
+    pool->nb_used = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t pool_used(pool_t* pool) {
+    size_t used;
+
+    pthread_mutex_lock(&pool->lock);
+    used = pool->nb_used;
+    pthread_mutex_unlock(&pool->lock);
+
+    return used;
+}
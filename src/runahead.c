@@ -0,0 +1,90 @@
+#include "runahead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static double priv_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+}
+
+static void priv_check(runahead_t* runahead, const chip8_t* chip8) {            /* did the core reach the frame we showed earlier */
+    int slot = chip8->nb_frames & (RUNAHEAD_HISTORY - 1);
+
+    if (runahead->predicted_frame[slot] != chip8->nb_frames) return;
+
+    runahead->nb_checked++;
+    if (runahead->predicted[slot] == chip8_display_hash(chip8)) {
+        runahead->nb_confirmed++;
+    }
+    runahead->predicted_frame[slot] = 0;
+}
+
+static int priv_copy(runahead_t* runahead, const chip8_t* chip8) {             /* TRUE when the display changed */
+    size_t size = chip8_display_size(chip8);
+    int changed;
+
+    changed = memcmp(&runahead->display_mode, &chip8->display_mode, sizeof(display_mode_t)) != 0
+        || memcmp(runahead->display, chip8->display, size) != 0;
+    runahead->display_mode = chip8->display_mode;
+    memcpy(runahead->display, chip8->display, size);
+
+    return changed;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+void runahead_init(runahead_t* runahead, int frames) {
+    if (frames < 1 || frames > RUNAHEAD_MAX_FRAMES) {
+        printf("[ERROR] Run-ahead must be between 1 and %d frames\n", RUNAHEAD_MAX_FRAMES);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(runahead, 0, sizeof(runahead_t));
+    runahead->frames = frames;
+}
+
+int runahead_present(runahead_t* runahead, chip8_t* chip8, int frames) {
+    chip8_state_t state;
+    double start;
+    int changed;
+
+    if (frames > 0) {
+        start = priv_now();
+        priv_check(runahead, chip8);
+
+        chip8_save_state(chip8, &state);                                        /* pages are shared, only the ones written are copied */
+        for (int i = 0; i < frames; i++) {
+            chip8_run_frame(chip8, chip8->keys_current_state);                  /* input held, as if the player keeps it down */
+        }
+
+        int slot = chip8->nb_frames & (RUNAHEAD_HISTORY - 1);
+        runahead->predicted[slot] = chip8_display_hash(chip8);
+        runahead->predicted_frame[slot] = chip8->nb_frames;
+
+        changed = priv_copy(runahead, chip8);
+
+        chip8_load_state(chip8, &state);
+        chip8_release_state(&state);
+
+        runahead->cost = priv_now() - start;
+        if (runahead->cost > runahead->max_cost) {
+            runahead->max_cost = runahead->cost;
+        }
+        return changed;
+    }
+
+    return priv_copy(runahead, chip8);
+}
@@ -0,0 +1,87 @@
+#include "search.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define SEARCH_CHUNK  16                    /* instances per work item */
+
+
+struct search {
+    workers_t* workers;
+
+    chip8_t** instances;                    /* arguments of the running search_run() */
+    int count;
+    const uint16_t* keys;
+    int frames;
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_run_chunk(void* ctx, size_t chunk) {
+    search_t* search = ctx;
+    size_t start = chunk * SEARCH_CHUNK;
+    size_t end = start + SEARCH_CHUNK;
+
+    if (end > (size_t)search->count) {
+        end = search->count;
+    }
+
+    for (size_t i = start; i < end; i++) {
+        const uint16_t* keys = search->keys != NULL ? search->keys + i * search->frames : NULL;
+
+        for (int f = 0; f < search->frames; f++) {
+            chip8_run_frame(search->instances[i], keys != NULL ? keys[f] : 0);
+        }
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+search_t* search_init(int nb_threads) {
+    search_t* search = calloc(1, sizeof(search_t));
+
+    if (search == NULL) {
+        printf("[ERROR] Cant allocate search\n");
+        exit(EXIT_FAILURE);
+    }
+    search->workers = workers_init(nb_threads);
+
+    return search;
+}
+
+void search_quit(search_t* search) {
+    workers_quit(search->workers);
+    free(search);
+}
+
+void search_fork(chip8_t* parent, chip8_t** children, int count, uint32_t seed) {     /* one thread, the page counts of the parent are shared cache lines */
+    for (int i = 0; i < count; i++) {
+        children[i] = chip8_fork(parent);
+        if (seed != 0) {
+            children[i]->rng = (seed + i * 0x9E3779B9u) | 1;
+        }
+    }
+}
+
+void search_run(search_t* search, chip8_t** instances, int count, const uint16_t* keys, int frames) {
+    search->instances = instances;
+    search->count = count;
+    search->keys = keys;
+    search->frames = frames;
+
+    workers_run(search->workers, priv_run_chunk, search, (count + SEARCH_CHUNK - 1) / SEARCH_CHUNK);
+}
+
+void search_destroy(chip8_t** instances, int count) {
+    for (int i = 0; i < count; i++) {
+        chip8_destroy(instances[i]);
+    }
+}
@@ -0,0 +1,589 @@
+#include "server.h"
+#include "chip8.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define SERVER_MAX_EVENTS   64
+#define SERVER_READ_SIZE    65536          /* bytes read per recv() */
+
+
+typedef struct session {
+    chip8_t* chip8;                         /* NULL for a free slot */
+    uint16_t* keys;                         /* queued key masks, one per frame */
+    uint32_t nb_keys, next_key, keys_size;
+    uint16_t held;                          /* keys of the last frame, held once the queue is empty */
+    uint32_t step_frames;                   /* frames to run in the pending STEP group */
+} session_t;
+
+typedef struct connection {
+    int fd;
+    uint8_t* in;                            /* received, not yet processed */
+    size_t in_len, in_size;
+    uint8_t* out;                           /* replies not yet sent, from out_pos */
+    size_t out_len, out_pos, out_size;
+    int want_write;                         /* EPOLLOUT armed */
+
+    session_t* sessions;                    /* session id - 1 */
+    uint32_t nb_sessions, sessions_size;
+} connection_t;
+
+typedef struct rom_entry {
+    uint64_t hash;
+    uint8_t* bytes;                         /* compared on lookup, the hash only narrows it down */
+    size_t len;
+    rom_t* rom;
+} rom_entry_t;
+
+struct server {
+    int listen_fd, epoll_fd;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    workers_t* workers;
+
+    session_t** group;                      /* sessions with a pending STEP */
+    int nb_group, group_size;
+
+    rom_entry_t roms[SERVER_ROM_CACHE];
+    int next_rom;                           /* replaced next when the cache is full */
+
+    connection_t** connections;             /* for server_quit() */
+    int nb_connections, connections_size;
+
+    uint64_t nb_batches, nb_requests, nb_created;
+};
+
+
+static volatile sig_atomic_t quit_requested = FALSE;
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_signal_handler(int sig) {
+    (void)sig;
+    quit_requested = TRUE;
+}
+
+static void* priv_grow(void* data, size_t* size, size_t needed, size_t elem_size) {     /* doubles *size until needed fits */
+    size_t new_size = *size > 0 ? *size : 16;
+
+    if (needed <= *size) return data;
+
+    while (new_size < needed) {
+        new_size *= 2;
+    }
+    data = realloc(data, new_size * elem_size);
+    if (data == NULL) {
+        printf("[ERROR] Cant grow server buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    *size = new_size;
+
+    return data;
+}
+
+static uint64_t priv_hash_bytes(const uint8_t* data, size_t len) {              /* FNV-1a */
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static rom_t* priv_rom(server_t* server, const uint8_t* data, size_t len) {     /* borrowed reference, NULL when it does not fit */
+    uint64_t hash = priv_hash_bytes(data, len);
+    rom_entry_t* entry;
+    rom_t* rom;
+
+    for (int i = 0; i < SERVER_ROM_CACHE; i++) {
+        entry = &server->roms[i];
+        if (entry->rom != NULL && entry->hash == hash && entry->len == len && memcmp(entry->bytes, data, len) == 0) {
+            return entry->rom;
+        }
+    }
+
+    rom = rom_create(data, len);
+    if (rom == NULL) return NULL;
+
+    entry = &server->roms[server->next_rom];
+    server->next_rom = (server->next_rom + 1) % SERVER_ROM_CACHE;
+    if (entry->rom != NULL) {                                                   /* sessions keep their own reference */
+        rom_release(entry->rom);
+        free(entry->bytes);
+    }
+
+    entry->bytes = malloc(len);
+    if (entry->bytes == NULL) {
+        printf("[ERROR] Cant allocate rom cache entry\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry->bytes, data, len);
+    entry->hash = hash;
+    entry->len = len;
+    entry->rom = rom;
+
+    return rom;
+}
+
+static void priv_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        printf("[ERROR] Cant make socket non blocking: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static session_t* priv_session(connection_t* connection, uint32_t id) {
+    if (id == 0 || id > connection->nb_sessions) return NULL;
+    if (connection->sessions[id - 1].chip8 == NULL) return NULL;
+
+    return &connection->sessions[id - 1];
+}
+
+static uint32_t priv_add_session(connection_t* connection, chip8_t* chip8) {   /* returns the id */
+    uint32_t index;
+    size_t size = connection->sessions_size;
+
+    for (index = 0; index < connection->nb_sessions; index++) {                 /* reuse the first free slot */
+        if (connection->sessions[index].chip8 == NULL) break;
+    }
+    if (index == connection->nb_sessions) {
+        connection->sessions = priv_grow(connection->sessions, &size, index + 1, sizeof(session_t));
+        connection->sessions_size = size;
+        connection->nb_sessions++;
+    }
+
+    memset(&connection->sessions[index], 0, sizeof(session_t));
+    connection->sessions[index].chip8 = chip8;
+
+    return index + 1;
+}
+
+static void priv_remove_session(session_t* session) {
+    chip8_destroy(session->chip8);
+    free(session->keys);
+    memset(session, 0, sizeof(session_t));
+}
+
+static void priv_queue_keys(session_t* session, const uint8_t* data, uint32_t nb_keys) {
+    size_t size = session->keys_size;
+
+    if (session->next_key > 0) {                                                /* drop the keys already played */
+        session->nb_keys -= session->next_key;
+        memmove(session->keys, session->keys + session->next_key, session->nb_keys * sizeof(uint16_t));
+        session->next_key = 0;
+    }
+
+    session->keys = priv_grow(session->keys, &size, session->nb_keys + nb_keys, sizeof(uint16_t));
+    session->keys_size = size;
+    memcpy(session->keys + session->nb_keys, data, nb_keys * sizeof(uint16_t));
+    session->nb_keys += nb_keys;
+}
+
+static void priv_step(void* ctx, size_t index) {                                /* one session of the STEP group, on a worker */
+    session_t* session = ((session_t**)ctx)[index];
+
+    for (uint32_t f = 0; f < session->step_frames; f++) {
+        if (session->next_key < session->nb_keys) {
+            session->held = session->keys[session->next_key++];
+        }
+        chip8_run_frame(session->chip8, session->held);
+    }
+    session->step_frames = 0;
+}
+
+static void priv_flush_steps(server_t* server) {
+    if (server->nb_group == 0) return;
+
+    workers_run(server->workers, priv_step, server->group, server->nb_group);
+    server->nb_group = 0;
+}
+
+static void priv_reply(connection_t* connection, const server_request_t* request, server_status_t status, uint32_t session, uint64_t value, const void* payload, uint32_t len) {
+    server_reply_t reply = { .op = request->op, .status = status, .session = session, .value = value, .len = len };
+
+    connection->out = priv_grow(connection->out, &connection->out_size, connection->out_len + sizeof(reply) + len, 1);
+    memcpy(connection->out + connection->out_len, &reply, sizeof(reply));
+    connection->out_len += sizeof(reply);
+    if (len > 0) {
+        memcpy(connection->out + connection->out_len, payload, len);
+        connection->out_len += len;
+    }
+}
+
+static void priv_create(server_t* server, connection_t* connection, const server_request_t* request, const uint8_t* payload) {
+    variant_t variant = request->flags & ~SERVER_CREATE_VIP;
+    int vip = (request->flags & SERVER_CREATE_VIP) != 0;
+    chip8_t* chip8;
+    rom_t* rom;
+
+    if (variant > VARIANT_XOCHIP || (vip && variant != VARIANT_CHIP8)) {
+        priv_reply(connection, request, SERVER_ERR_OP, 0, 0, NULL, 0);
+        return;
+    }
+    if (request->len == 0 || (variant != VARIANT_XOCHIP && request->len > MEMORY_SIZE - ROM_START_ADR)) {
+        priv_reply(connection, request, SERVER_ERR_ROM, 0, 0, NULL, 0);
+        return;
+    }
+    rom = priv_rom(server, payload, request->len);
+    if (rom == NULL) {
+        priv_reply(connection, request, SERVER_ERR_ROM, 0, 0, NULL, 0);
+        return;
+    }
+
+    chip8 = chip8_create(rom);
+    if (variant != VARIANT_CHIP8) {
+        chip8_set_variant(chip8, variant);
+    }
+    chip8->timing = vip ? TIMING_VIP : TIMING_FLAT;
+    if (request->arg != 0) {
+        chip8->rng = request->arg;
+    }
+
+    server->nb_created++;
+    priv_reply(connection, request, SERVER_OK, priv_add_session(connection, chip8), 0, NULL, 0);
+}
+
+static void priv_request(server_t* server, connection_t* connection, const server_request_t* request, const uint8_t* payload) {
+    session_t* session;
+    uint32_t id;
+
+    if (request->op == SERVER_OP_STEP) {                                        /* deferred, runs with the next steps */
+        session = priv_session(connection, request->session);
+        if (session == NULL) {
+            priv_reply(connection, request, SERVER_ERR_SESSION, request->session, 0, NULL, 0);
+            return;
+        }
+        if (session->step_frames == 0 && request->arg > 0) {
+            size_t size = server->group_size;
+
+            server->group = priv_grow(server->group, &size, server->nb_group + 1, sizeof(session_t*));
+            server->group_size = size;
+            server->group[server->nb_group++] = session;
+        }
+        session->step_frames += request->arg;
+        priv_reply(connection, request, SERVER_OK, request->session, request->arg, NULL, 0);
+        return;
+    }
+
+    priv_flush_steps(server);                                                   /* every other request sees the stepped state */
+
+    if (request->op == SERVER_OP_CREATE) {
+        priv_create(server, connection, request, payload);
+        return;
+    }
+
+    session = priv_session(connection, request->session);
+    if (session == NULL) {
+        priv_reply(connection, request, SERVER_ERR_SESSION, request->session, 0, NULL, 0);
+        return;
+    }
+
+    switch (request->op) {
+        case SERVER_OP_FORK:
+            id = priv_add_session(connection, chip8_fork(session->chip8));      /* may move the sessions */
+            server->nb_created++;
+            priv_reply(connection, request, SERVER_OK, id, 0, NULL, 0);
+            break;
+        case SERVER_OP_DESTROY:
+            priv_remove_session(session);
+            priv_reply(connection, request, SERVER_OK, request->session, 0, NULL, 0);
+            break;
+        case SERVER_OP_RESET:
+            chip8_reset(session->chip8);
+            session->nb_keys = session->next_key = 0;
+            session->held = 0;
+            priv_reply(connection, request, SERVER_OK, request->session, 0, NULL, 0);
+            break;
+        case SERVER_OP_KEYS:
+            if (request->len % sizeof(uint16_t) != 0) {
+                priv_reply(connection, request, SERVER_ERR_OP, request->session, 0, NULL, 0);
+                break;
+            }
+            priv_queue_keys(session, payload, request->len / sizeof(uint16_t));
+            priv_reply(connection, request, SERVER_OK, request->session, session->nb_keys - session->next_key, NULL, 0);
+            break;
+        case SERVER_OP_HASH:
+            priv_reply(connection, request, SERVER_OK, request->session, chip8_display_hash(session->chip8), NULL, 0);
+            break;
+        case SERVER_OP_FRAME: {
+            const chip8_t* chip8 = session->chip8;
+            uint64_t mode = chip8->display_mode.width | (chip8->display_mode.height << 16);
+
+            priv_reply(connection, request, SERVER_OK, request->session, mode, chip8->display, chip8_display_size(chip8));
+            break;
+        }
+        default:
+            priv_reply(connection, request, SERVER_ERR_OP, request->session, 0, NULL, 0);
+            break;
+    }
+}
+
+static int priv_batch(server_t* server, connection_t* connection, const uint8_t* data, const server_batch_t* batch) {     /* FALSE on a malformed batch */
+    server_batch_t reply_batch = { .count = batch->count };
+    size_t header = connection->out_len;
+    size_t pos = 0;
+    int valid = TRUE;
+
+    connection->out = priv_grow(connection->out, &connection->out_size, connection->out_len + sizeof(reply_batch), 1);
+    connection->out_len += sizeof(reply_batch);
+
+    for (uint32_t i = 0; i < batch->count && valid; i++) {
+        server_request_t request;
+
+        valid = batch->size - pos >= sizeof(request);
+        if (valid) {
+            memcpy(&request, data + pos, sizeof(request));
+            pos += sizeof(request);
+            valid = batch->size - pos >= request.len;
+        }
+        if (valid) {
+            priv_request(server, connection, &request, data + pos);
+            pos += request.len;
+        }
+    }
+    priv_flush_steps(server);                                                   /* before the sessions can go away */
+    if (!valid) return FALSE;
+
+    server->nb_batches++;
+    server->nb_requests += batch->count;
+
+    reply_batch.size = connection->out_len - header - sizeof(reply_batch);
+    memcpy(connection->out + header, &reply_batch, sizeof(reply_batch));
+
+    return pos == batch->size;
+}
+
+static void priv_close(server_t* server, connection_t* connection) {
+    for (uint32_t i = 0; i < connection->nb_sessions; i++) {
+        if (connection->sessions[i].chip8 != NULL) {
+            priv_remove_session(&connection->sessions[i]);
+        }
+    }
+    for (int i = 0; i < server->nb_connections; i++) {
+        if (server->connections[i] == connection) {
+            server->connections[i] = server->connections[--server->nb_connections];
+            break;
+        }
+    }
+
+    close(connection->fd);                                                      /* also removes it from the epoll set */
+    free(connection->sessions);
+    free(connection->in);
+    free(connection->out);
+    free(connection);
+}
+
+static void priv_accept(server_t* server) {
+    struct epoll_event event = { .events = EPOLLIN };
+    connection_t* connection;
+    size_t size;
+    int fd;
+
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+        priv_set_nonblocking(fd);
+        connection = calloc(1, sizeof(connection_t));
+        if (connection == NULL) {
+            printf("[ERROR] Cant allocate connection\n");
+            exit(EXIT_FAILURE);
+        }
+        connection->fd = fd;
+
+        event.data.ptr = connection;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            printf("[ERROR] Cant watch connection: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        size = server->connections_size;
+        server->connections = priv_grow(server->connections, &size, server->nb_connections + 1, sizeof(connection_t*));
+        server->connections_size = size;
+        server->connections[server->nb_connections++] = connection;
+    }
+}
+
+static int priv_flush_out(server_t* server, connection_t* connection) {        /* FALSE when the peer is gone */
+    struct epoll_event event = { .data.ptr = connection };
+    ssize_t sent;
+
+    while (connection->out_pos < connection->out_len) {
+        sent = send(connection->fd, connection->out + connection->out_pos, connection->out_len - connection->out_pos, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) return FALSE;
+            break;
+        }
+        connection->out_pos += sent;
+    }
+    if (connection->out_pos == connection->out_len) {
+        connection->out_pos = connection->out_len = 0;
+    }
+
+    if (connection->want_write != (connection->out_len > 0)) {                   /* wait for room only while replies are pending */
+        connection->want_write = connection->out_len > 0;
+        event.events = EPOLLIN | (connection->want_write ? EPOLLOUT : 0);
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+
+    return TRUE;
+}
+
+static int priv_read(server_t* server, connection_t* connection) {             /* FALSE when the connection must close */
+    server_batch_t batch;
+    size_t pos = 0;
+    ssize_t received;
+    int eof = FALSE;
+
+    for (;;) {
+        connection->in = priv_grow(connection->in, &connection->in_size, connection->in_len + SERVER_READ_SIZE, 1);
+        received = recv(connection->fd, connection->in + connection->in_len, SERVER_READ_SIZE, 0);
+        if (received == 0) {                                                    /* answer what came before, best effort */
+            eof = TRUE;
+            break;
+        }
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) return FALSE;
+            break;
+        }
+        connection->in_len += received;
+    }
+
+    while (connection->in_len - pos >= sizeof(batch)) {                         /* every complete batch */
+        memcpy(&batch, connection->in + pos, sizeof(batch));
+        if (batch.size > SERVER_MAX_BATCH) return FALSE;
+        if (connection->in_len - pos - sizeof(batch) < batch.size) break;
+
+        if (!priv_batch(server, connection, connection->in + pos + sizeof(batch), &batch)) return FALSE;
+        pos += sizeof(batch) + batch.size;
+    }
+    connection->in_len -= pos;
+    memmove(connection->in, connection->in + pos, connection->in_len);
+
+    return priv_flush_out(server, connection) && !eof;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+server_t* server_init(const char* path, int nb_threads) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    server_t* server;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("[ERROR] Socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    server = calloc(1, sizeof(server_t));
+    if (server == NULL) {
+        printf("[ERROR] Cant allocate server\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(server->path, path);
+    strcpy(addr.sun_path, path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        printf("[ERROR] Cant create socket: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    priv_set_nonblocking(server->listen_fd);
+    unlink(path);
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server->listen_fd, SOMAXCONN) < 0) {
+        printf("[ERROR] Cant listen on %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0 || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) < 0) {
+        printf("[ERROR] Cant create epoll instance: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    server->workers = workers_init(nb_threads);
+
+    return server;
+}
+
+void server_quit(server_t* server) {
+    while (server->nb_connections > 0) {
+        priv_close(server, server->connections[0]);
+    }
+    for (int i = 0; i < SERVER_ROM_CACHE; i++) {
+        if (server->roms[i].rom != NULL) {
+            rom_release(server->roms[i].rom);
+            free(server->roms[i].bytes);
+        }
+    }
+
+    printf("%" PRIu64 " batches, %" PRIu64 " requests, %" PRIu64 " sessions created\n", server->nb_batches, server->nb_requests, server->nb_created);
+
+    workers_quit(server->workers);
+    close(server->epoll_fd);
+    close(server->listen_fd);
+    unlink(server->path);
+    free(server->connections);
+    free(server->group);
+    free(server);
+}
+
+void server_main_loop(server_t* server) {
+    struct sigaction action = { .sa_handler = priv_signal_handler };            /* no SA_RESTART, epoll_wait() returns */
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int nb_events;
+
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    while (!quit_requested) {
+        nb_events = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (nb_events < 0) {
+            if (errno == EINTR) continue;
+            printf("[ERROR] epoll_wait failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < nb_events; i++) {
+            connection_t* connection = events[i].data.ptr;
+            int alive = TRUE;
+
+            if (connection == NULL) {
+                priv_accept(server);
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                alive = (events[i].events & EPOLLIN) != 0;                       /* read what is left, recv() then sees the end */
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = priv_flush_out(server, connection);
+            }
+            if (alive && (events[i].events & EPOLLIN)) {
+                alive = priv_read(server, connection);
+            }
+            if (!alive) {
+                priv_close(server, connection);
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#include "timing.h"
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static const uint16_t group_cycles[16] = {                                      /* instruction body, before operand dependent costs */
+    [0x0] = 10,                                                                 /* RET, CLS below */
+    [0x1] = 12,                                                                 /* JMP */
+    [0x2] = 26,                                                                 /* CALL */
+    [0x3] = 10,                                                                 /* SE, +4 when taken */
+    [0x4] = 10,                                                                 /* SNE */
+    [0x5] = 14,                                                                 /* SE Vx, Vy */
+    [0x6] = 6,                                                                  /* LD Vx, byte */
+    [0x7] = 10,                                                                 /* ADD Vx, byte */
+    [0x8] = 44,                                                                 /* ALU, 8XY0 below */
+    [0x9] = 14,                                                                 /* SNE Vx, Vy */
+    [0xA] = 12,                                                                 /* LD I */
+    [0xB] = 22,                                                                 /* JP V0 */
+    [0xC] = 36,                                                                 /* RND */
+    [0xD] = 26,                                                                 /* DRW, plus rows below */
+    [0xE] = 14,                                                                 /* SKP / SKNP */
+    [0xF] = 10,                                                                 /* FXnn, see below */
+};
+
+static int priv_skip_cycles(const chip8_t* chip8, uint16_t pc) {
+    return chip8->cpu.PC == (uint16_t)(pc + 4) ? 4 : 0;
+}
+
+static int priv_FXnn_cycles(const chip8_t* chip8, uint8_t X, uint8_t nn) {
+    uint16_t I = chip8->cpu.I;
+
+    switch (nn) {
+        case 0x0A:                                                              /* LD Vx, K, per poll */
+            return 20;
+        case 0x1E:                                                              /* ADD I, Vx */
+        case 0x29:                                                              /* LD F, Vx */
+            return 16;
+        case 0x33:                                                              /* BCD, one loop per unit of each digit */
+            return 80 + 16 * (chip8_read(chip8, I) + chip8_read(chip8, I + 1) + chip8_read(chip8, I + 2));
+        case 0x55:                                                              /* LD [I], Vx */
+        case 0x65:                                                              /* LD Vx, [I] */
+            return 14 + 14 * (X + 1);
+        default:                                                                /* timers */
+            return group_cycles[0xF];
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+int timing_vip_cycles(const chip8_t* chip8, uint16_t opcode, uint16_t pc) {
+    uint8_t group = opcode >> 12;
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    int cycles = TIMING_VIP_FETCH_CYCLES + group_cycles[group];
+
+    switch (group) {
+        case 0x0:
+            if (opcode == 0x00E0) {                                             /* CLS, clears the 256 display bytes */
+                cycles += 3068;
+            }
+            break;
+        case 0x3: case 0x4: case 0x5: case 0x9: case 0xE:
+            cycles += priv_skip_cycles(chip8, pc);
+            break;
+        case 0x8:
+            if ((opcode & 0xF) == 0x0) {                                        /* LD Vx, Vy */
+                cycles = TIMING_VIP_FETCH_CYCLES + 12;
+            }
+            break;
+        case 0xD: {                                                             /* unaligned rows touch two display bytes */
+            int aligned = (chip8->cpu.V[X] & 7) == 0;
+
+            cycles += (opcode & 0xF) * (aligned ? 46 : 68);
+            break;
+        }
+        case 0xF:
+            cycles = TIMING_VIP_FETCH_CYCLES + priv_FXnn_cycles(chip8, X, opcode & 0xFF);
+            break;
+        default:
+            break;
+    }
+
+    return cycles;
+}
@@ -0,0 +1,240 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+
+#define TRACE_BUFFER_SIZE  (256 * 1024)
+#define TRACE_NB_BUFFERS   4
+#define TRACE_MAX_RECORD   64               /* worst case instruction record is 56 bytes */
+
+
+struct trace {
+    FILE* file;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int quit;
+
+    uint8_t* buffers[TRACE_NB_BUFFERS];     /* filled and written in ring order */
+    size_t lengths[TRACE_NB_BUFFERS];
+    int full[TRACE_NB_BUFFERS];             /* handed to the writer */
+    int current;
+    size_t pos;
+
+    uint16_t expected_pc;                   /* PC + 2, or the target of JMP / CALL */
+    uint16_t last_keys;
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void* priv_writer(void* arg) {
+    trace_t* trace = arg;
+    int next = 0;
+
+    pthread_mutex_lock(&trace->lock);
+    for (;;) {
+        while (!trace->full[next] && !trace->quit) {
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        }
+        if (!trace->full[next]) break;                                          /* quit and drained */
+
+        pthread_mutex_unlock(&trace->lock);
+        fwrite(trace->buffers[next], sizeof(uint8_t), trace->lengths[next], trace->file);
+        pthread_mutex_lock(&trace->lock);
+
+        trace->full[next] = FALSE;
+        next = (next + 1) % TRACE_NB_BUFFERS;
+        pthread_cond_broadcast(&trace->cond);
+    }
+    pthread_mutex_unlock(&trace->lock);
+
+    return NULL;
+}
+
+static void priv_submit(trace_t* trace) {                                       /* hand the current buffer over, blocks only if the writer lags */
+    int next = (trace->current + 1) % TRACE_NB_BUFFERS;
+
+    pthread_mutex_lock(&trace->lock);
+    trace->lengths[trace->current] = trace->pos;
+    trace->full[trace->current] = TRUE;
+    pthread_cond_broadcast(&trace->cond);
+
+    while (trace->full[next]) {
+        pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    pthread_mutex_unlock(&trace->lock);
+
+    trace->current = next;
+    trace->pos = 0;
+}
+
+static inline uint8_t* priv_reserve(trace_t* trace) {
+    if (trace->pos > TRACE_BUFFER_SIZE - TRACE_MAX_RECORD) {
+        priv_submit(trace);
+    }
+    return trace->buffers[trace->current];
+}
+
+static inline size_t priv_put_varint(uint8_t* buffer, size_t pos, uint32_t value) {
+    while (value >= 0x80) {
+        buffer[pos++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buffer[pos++] = value;
+
+    return pos;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+trace_t* trace_open(const char* path) {
+    trace_t* trace;
+
+    trace = calloc(1, sizeof(trace_t));
+    if (trace == NULL) {
+        printf("[ERROR] Cant allocate trace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        printf("[ERROR] Cant open trace file: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < TRACE_NB_BUFFERS; i++) {
+        trace->buffers[i] = malloc(TRACE_BUFFER_SIZE);
+        if (trace->buffers[i] == NULL) {
+            printf("[ERROR] Cant allocate trace buffers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(trace->buffers[0], TRACE_MAGIC, 4);
+    trace->buffers[0][4] = TRACE_VERSION;
+    trace->pos = 5;
+    trace->expected_pc = ROM_START_ADR;
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    if (pthread_create(&trace->writer, NULL, priv_writer, trace) != 0) {
+        printf("[ERROR] Cant create trace writer thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return trace;
+}
+
+void trace_close(trace_t* trace) {
+    if (trace->pos > 0) {
+        priv_submit(trace);
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    trace->quit = TRUE;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->writer, NULL);
+
+    pthread_cond_destroy(&trace->cond);
+    pthread_mutex_destroy(&trace->lock);
+    fclose(trace->file);
+
+    for (int i = 0; i < TRACE_NB_BUFFERS; i++) {
+        free(trace->buffers[i]);
+    }
+    free(trace);
+}
+
+void trace_instruction(trace_t* trace, const cpu_t* before, const chip8_t* chip8, uint16_t opcode) {
+    const cpu_t* cpu = &chip8->cpu;
+    uint8_t* buffer = priv_reserve(trace);
+    size_t tag_pos = trace->pos, pos = trace->pos + 1;
+    uint16_t mask = 0;
+    uint8_t tag = 0;
+
+    buffer[pos++] = opcode >> 8;
+    buffer[pos++] = opcode & 0xFF;
+
+    if (before->PC != trace->expected_pc) {
+        tag |= TRACE_PC;
+        pos = priv_put_varint(buffer, pos, before->PC);
+    }
+    trace->expected_pc = trace_next_pc(before->PC, opcode);
+
+    if (memcmp(before->V, cpu->V, NB_REGISTER) != 0) {                          /* most instructions change nothing or one register */
+        for (int i = 0; i < NB_REGISTER; i++) {
+            if (before->V[i] != cpu->V[i]) {
+                mask |= 1 << i;
+            }
+        }
+
+        tag |= TRACE_REGS;
+        pos = priv_put_varint(buffer, pos, mask);
+        for (int i = 0; i < NB_REGISTER; i++) {
+            if (BIT_CHECK(mask, i)) {
+                buffer[pos++] = cpu->V[i];
+            }
+        }
+    }
+
+    if (before->I != cpu->I) {
+        tag |= TRACE_I;
+        pos = priv_put_varint(buffer, pos, cpu->I);
+    }
+
+    if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055 || ((opcode & 0xF00F) == 0x5002 && chip8->variant == VARIANT_XOCHIP)) {     /* the only memory stores */
+        uint8_t x = (opcode & 0x0F00) >> 8, y = (opcode & 0x00F0) >> 4;
+        uint8_t len = (opcode & 0xFF) == 0x33 ? 3 : (opcode & 0xF000) == 0x5000 ? (x > y ? x - y : y - x) + 1 : x + 1;
+
+        tag |= TRACE_MEM;
+        pos = priv_put_varint(buffer, pos, before->I & chip8->memory_mask);
+        buffer[pos++] = len;
+        for (uint8_t i = 0; i < len; i++) {
+            buffer[pos++] = chip8_read(chip8, before->I + i);
+        }
+    }
+
+    if (before->SP != cpu->SP) {
+        tag |= TRACE_STACK;
+        buffer[pos++] = cpu->SP;
+        if ((opcode & 0xF000) == 0x2000) {
+            pos = priv_put_varint(buffer, pos, cpu->stack[before->SP]);
+        }
+    }
+
+    if ((opcode & 0xF0FF) == 0xF015 || (opcode & 0xF0FF) == 0xF018) {
+        tag |= TRACE_TIMERS;
+        buffer[pos++] = cpu->DT;
+        buffer[pos++] = cpu->ST;
+    }
+
+    buffer[tag_pos] = tag;
+    trace->pos = pos;
+}
+
+void trace_frame(trace_t* trace, const chip8_t* chip8) {
+    uint8_t* buffer = priv_reserve(trace);
+    size_t pos = trace->pos;
+
+    buffer[pos++] = TRACE_FRAME;
+    buffer[pos++] = chip8->cpu.DT;
+    buffer[pos++] = chip8->cpu.ST;
+
+    if (chip8->keys_current_state != trace->last_keys) {
+        buffer[pos++] = TRACE_KEYS;
+        pos = priv_put_varint(buffer, pos, chip8->keys_current_state);
+        trace->last_keys = chip8->keys_current_state;
+    }
+
+    trace->pos = pos;
+}
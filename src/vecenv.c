@@ -0,0 +1,174 @@
+#include "vecenv.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define VECENV_CHUNK  64                    /* envs per work item */
+
+
+struct vecenv {
+    vecenv_config_t config;
+    workers_t* workers;
+    size_t obs_size;
+
+    chip8_t** envs;                         /* pool allocated, see chip8_create() */
+    uint32_t* episode_frames;
+
+    const uint16_t* actions;                /* arguments of the running step */
+    uint8_t* obs;
+    uint8_t* dones;
+};
+
+
+static uint64_t expand[256];               /* 8 pixels to 8 bytes, in memory order */
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_init_expand() {
+    for (int bits = 0; bits < 256; bits++) {
+        uint8_t bytes[8];
+
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (bits >> (7 - i)) & 1;
+        }
+        memcpy(&expand[bits], bytes, 8);
+    }
+}
+
+static void priv_write_obs(const vecenv_t* env, const chip8_t* chip8, uint8_t* obs) {
+    if (env->config.obs == VECENV_OBS_PACKED) {
+        memcpy(obs, chip8->display, CHIP8_DISPLAY_HEIGHT * sizeof(uint64_t));                  /* CHIP-8 only, always 64x32 */
+        return;
+    }
+
+    for (size_t y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+        uint64_t row = chip8->display[y];
+
+        for (int shift = CHIP8_DISPLAY_WIDTH - 8; shift >= 0; shift -= 8) {
+            memcpy(obs, &expand[(row >> shift) & 0xFF], 8);
+            obs += 8;
+        }
+    }
+}
+
+static int priv_is_done(const vecenv_t* env, const chip8_t* chip8, uint32_t frames) {
+    const vecenv_config_t* config = &env->config;
+
+    if (config->max_frames > 0 && frames >= (uint32_t)config->max_frames) {
+        return TRUE;
+    }
+    if (config->done_on_halt && chip8_fetch(chip8, chip8->cpu.PC) == (0x1000 | (chip8->cpu.PC & 0x0FFF))) {
+        return TRUE;
+    }
+    if (config->done != NULL && config->done(chip8, config->done_ctx)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void priv_step_chunk(void* ctx, size_t chunk) {
+    vecenv_t* env = ctx;
+    size_t start = chunk * VECENV_CHUNK;
+    size_t end = start + VECENV_CHUNK;
+
+    if (end > (size_t)env->config.nb_envs) {
+        end = env->config.nb_envs;
+    }
+
+    for (size_t i = start; i < end; i++) {
+        chip8_t* chip8 = env->envs[i];
+        int done;
+
+        chip8->keys_last_state = chip8->keys_current_state;                    /* the action is held during this frame */
+        chip8->keys_current_state = env->actions[i];
+        chip8_run_frame(chip8, env->actions[i]);
+
+        done = priv_is_done(env, chip8, ++env->episode_frames[i]);
+        if (done) {                                                             /* rng keeps going, episodes differ */
+            chip8_reset(chip8);
+            env->episode_frames[i] = 0;
+        }
+
+        env->dones[i] = done;
+        priv_write_obs(env, chip8, env->obs + i * env->obs_size);
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+vecenv_t* vecenv_init(rom_t* rom, const vecenv_config_t* config) {
+    vecenv_t* env;
+
+    env = calloc(1, sizeof(vecenv_t));
+    if (env == NULL) {
+        printf("[ERROR] Cant allocate vecenv\n");
+        exit(EXIT_FAILURE);
+    }
+
+    env->config = *config;
+    env->obs_size = config->obs == VECENV_OBS_PACKED ? CHIP8_DISPLAY_HEIGHT * sizeof(uint64_t) : CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT;
+    env->envs = malloc(config->nb_envs * sizeof(chip8_t*));
+    env->episode_frames = calloc(config->nb_envs, sizeof(uint32_t));
+    if (env->envs == NULL || env->episode_frames == NULL) {
+        printf("[ERROR] Cant allocate vecenv\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < config->nb_envs; i++) {
+        env->envs[i] = chip8_create(rom);
+        env->envs[i]->rng = (config->seed + i * 0x9E3779B9u) | 1;
+    }
+    env->workers = workers_init(config->nb_threads);
+
+    if (expand[1] == 0) {
+        priv_init_expand();
+    }
+
+    return env;
+}
+
+void vecenv_quit(vecenv_t* env) {
+    workers_quit(env->workers);
+
+    for (int i = 0; i < env->config.nb_envs; i++) {
+        chip8_destroy(env->envs[i]);
+    }
+    free(env->episode_frames);
+    free(env->envs);
+    free(env);
+}
+
+size_t vecenv_obs_size(const vecenv_t* env) {
+    return env->obs_size;
+}
+
+chip8_t* vecenv_get(vecenv_t* env, int index) {
+    return env->envs[index];
+}
+
+void vecenv_reset(vecenv_t* env, void* obs) {
+    for (int i = 0; i < env->config.nb_envs; i++) {
+        chip8_reset(env->envs[i]);
+        env->episode_frames[i] = 0;
+        priv_write_obs(env, env->envs[i], (uint8_t*)obs + i * env->obs_size);
+    }
+}
+
+void vecenv_step(vecenv_t* env, const uint16_t* actions, void* obs, uint8_t* dones) {
+    size_t nb_chunks = (env->config.nb_envs + VECENV_CHUNK - 1) / VECENV_CHUNK;
+
+    env->actions = actions;
+    env->obs = obs;
+    env->dones = dones;
+
+    workers_run(env->workers, priv_step_chunk, env, nb_chunks);
+}
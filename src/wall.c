@@ -0,0 +1,100 @@
+#include "wall.h"
+#include "chip8.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+struct wall {
+    gui_wall_t gui;
+    workers_t* workers;
+
+    chip8_t** instances;                    /* share the rom pages, see chip8_create() */
+    int nb_instances;
+    uint16_t keys;                          /* held by the focused instance */
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_run_frame(void* ctx, size_t index) {
+    wall_t* wall = ctx;
+
+    chip8_run_frame(wall->instances[index], (int)index == wall->gui.focus ? wall->keys : 0);
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+wall_t* wall_init(const args_t* args) {
+    uint32_t seed = (uint32_t)time(NULL);
+    wall_t* wall;
+    rom_t* rom;
+
+    wall = calloc(1, sizeof(wall_t));
+    if (wall != NULL) {
+        wall->instances = calloc(args->wall, sizeof(chip8_t*));
+    }
+    if (wall == NULL || wall->instances == NULL) {
+        printf("[ERROR] Cant allocate wall\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (args->variant != VARIANT_CHIP8) {
+        printf("[ERROR] The wall only runs CHIP-8 roms\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rom = rom_load(args->rom_path);
+    for (int i = 0; i < args->wall; i++) {                                      /* same rom, different rng */
+        chip8_t* chip8 = chip8_create(rom);
+
+        chip8->ips = args->ips == 0 ? DEFAULT_UPDATE_RATE_CHIP8 : args->ips;
+        chip8->timing = args->timing;
+        chip8->rng = (seed + i * 0x9E3779B9u) | 1;
+        wall->instances[i] = chip8;
+    }
+    rom_release(rom);
+
+    wall->nb_instances = args->wall;
+    wall->workers = workers_init(0);
+    gui_wall_init(&wall->gui, "Chip8 wall", wall->nb_instances, args->scale);
+
+    return wall;
+}
+
+void wall_quit(wall_t* wall) {
+    gui_wall_quit(&wall->gui);
+    workers_quit(wall->workers);
+
+    for (int i = 0; i < wall->nb_instances; i++) {
+        chip8_destroy(wall->instances[i]);
+    }
+    free(wall->instances);
+    free(wall);
+}
+
+void wall_main_loop(wall_t* wall) {                                             /* paced at 60Hz by gui_wall_render() */
+    while (wall->gui.running) {
+        gui_wall_poll_events(&wall->gui, &wall->keys);
+
+        workers_run(wall->workers, priv_run_frame, wall, wall->nb_instances);
+
+        for (int i = 0; i < wall->nb_instances; i++) {                          /* only changed tiles are redrawn in the atlas */
+            chip8_t* chip8 = wall->instances[i];
+
+            if (chip8->display_dirty) {
+                gui_wall_set_tile(&wall->gui, i, chip8->display);
+                chip8->display_dirty = FALSE;
+            }
+        }
+
+        gui_wall_render(&wall->gui);
+    }
+}
@@ -0,0 +1,228 @@
+#include "watchdog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+
+#define WATCHDOG_SLOTS  (4 * WATCHDOG_WINDOW)  /* per generation, at most half full */
+
+
+typedef struct watchdog_slot {
+    uint64_t hash;                          /* 0 for an empty slot */
+    uint64_t frame;
+} watchdog_slot_t;
+
+struct watchdog {
+    page_t* pages[NB_MAX_PAGES];            /* page hashed in page_hashes, NULL before the first check */
+    uint64_t page_hashes[NB_MAX_PAGES];
+    uint64_t memory_hash;                   /* sum of the page terms, see priv_page_term() */
+    uint64_t display_hash;
+    int started;
+
+    watchdog_slot_t* current;               /* states since generation_start */
+    watchdog_slot_t* previous;              /* the WATCHDOG_WINDOW frames before */
+    uint64_t generation_start;
+
+    watchdog_reason_t reason;
+    uint64_t since;                         /* first frame of the cycle */
+    uint64_t period;                        /* frames */
+    uint16_t pc;
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static inline uint64_t priv_mix(uint64_t x) {                                   /* splitmix64 finalizer */
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+static uint64_t priv_hash_words(const void* data, size_t len, uint64_t hash) {  /* len is a multiple of 8 */
+    const uint8_t* bytes = data;
+    uint64_t word;
+
+    for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+static uint64_t priv_page_term(uint64_t page_hash, int index) {                 /* position dependent, summed */
+    return priv_mix(page_hash ^ ((uint64_t)index << 48));
+}
+
+static void priv_update_memory(watchdog_t* watchdog, chip8_t* chip8) {         /* rehash the pages written or swapped since the last check */
+    uint64_t written = chip8->written_pages;
+
+    for (int i = 0; i < chip8_nb_pages(chip8); i++) {
+        page_t* page = chip8->pages[i];
+
+        if (page == watchdog->pages[i] && !((written >> (i & 63)) & 1)) continue;
+
+        if (watchdog->pages[i] != NULL) {
+            watchdog->memory_hash -= priv_page_term(watchdog->page_hashes[i], i);
+        }
+        watchdog->pages[i] = page;
+        watchdog->page_hashes[i] = priv_hash_words(page->data, PAGE_SIZE, 0);
+        watchdog->memory_hash += priv_page_term(watchdog->page_hashes[i], i);
+    }
+    chip8->written_pages = 0;
+}
+
+static uint64_t priv_state_hash(const watchdog_t* watchdog, const chip8_t* chip8) {
+    const cpu_t* cpu = &chip8->cpu;
+    uint64_t hash;
+
+    hash = priv_hash_words(cpu->V, sizeof(cpu->V), 0);
+    hash = priv_hash_words(cpu->stack, sizeof(cpu->stack), hash);
+    hash = priv_mix(hash ^ (cpu->DT | (cpu->ST << 8) | ((uint64_t)cpu->I << 16) | ((uint64_t)cpu->SP << 32) | ((uint64_t)cpu->PC << 40)));
+    hash = priv_mix(hash ^ (chip8->keys_current_state | ((uint64_t)chip8->keys_last_state << 16) | ((uint64_t)chip8->wait_next_frame << 32) | ((uint64_t)chip8->planes << 40)));
+    hash = priv_mix(hash ^ (chip8->rng | ((uint64_t)(uint32_t)chip8->cycles << 32)));
+    if (chip8->ext != NULL) {
+        hash = priv_hash_words(chip8->ext->flags, NB_FLAGS, hash);
+        hash = priv_hash_words(chip8->ext->audio_pattern, sizeof(chip8->ext->audio_pattern), hash);
+        hash = priv_mix(hash ^ chip8->ext->pitch);
+    }
+    hash = priv_mix(hash ^ watchdog->display_hash);
+    hash = priv_mix(hash ^ watchdog->memory_hash);
+
+    return hash != 0 ? hash : 1;
+}
+
+static const watchdog_slot_t* priv_find(const watchdog_slot_t* table, uint64_t hash) {
+    for (size_t i = hash & (WATCHDOG_SLOTS - 1); table[i].hash != 0; i = (i + 1) & (WATCHDOG_SLOTS - 1)) {
+        if (table[i].hash == hash) return &table[i];
+    }
+
+    return NULL;
+}
+
+static void priv_insert(watchdog_t* watchdog, uint64_t hash, uint64_t frame) {
+    watchdog_slot_t* table;
+    size_t i;
+
+    if (frame - watchdog->generation_start >= WATCHDOG_WINDOW) {                /* the oldest generation goes */
+        table = watchdog->previous;
+        watchdog->previous = watchdog->current;
+        watchdog->current = table;
+        memset(table, 0, WATCHDOG_SLOTS * sizeof(watchdog_slot_t));
+        watchdog->generation_start = frame;
+    }
+
+    table = watchdog->current;
+    for (i = hash & (WATCHDOG_SLOTS - 1); table[i].hash != 0; i = (i + 1) & (WATCHDOG_SLOTS - 1));
+    table[i].hash = hash;
+    table[i].frame = frame;
+}
+
+static watchdog_reason_t priv_classify(const chip8_t* chip8) {                /* the period can exceed 1, --timing vip budgets keep changing */
+    uint16_t pc = chip8->cpu.PC;
+    uint16_t opcode = chip8_fetch(chip8, pc);
+
+    if ((opcode & 0xF000) == 0x1000 && (opcode & 0x0FFF) == pc) {
+        return WATCHDOG_HALTED;
+    }
+    if (opcode == 0x00FD && chip8->ext != NULL) {
+        return WATCHDOG_HALTED;
+    }
+    if ((opcode & 0xF0FF) == 0xF00A) {
+        return WATCHDOG_WAITING_KEY;
+    }
+
+    return WATCHDOG_CYCLE;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+watchdog_t* watchdog_open() {
+    watchdog_t* watchdog = calloc(1, sizeof(watchdog_t));
+
+    if (watchdog != NULL) {
+        watchdog->current = calloc(WATCHDOG_SLOTS, sizeof(watchdog_slot_t));
+        watchdog->previous = calloc(WATCHDOG_SLOTS, sizeof(watchdog_slot_t));
+    }
+    if (watchdog == NULL || watchdog->current == NULL || watchdog->previous == NULL) {
+        printf("[ERROR] Cant allocate watchdog\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return watchdog;
+}
+
+void watchdog_close(watchdog_t* watchdog) {
+    free(watchdog->current);
+    free(watchdog->previous);
+    free(watchdog);
+}
+
+watchdog_reason_t watchdog_check(watchdog_t* watchdog, chip8_t* chip8, int display_changed, int inputs_fixed) {
+    const watchdog_slot_t* seen;
+    uint64_t hash;
+
+    if (watchdog->reason != WATCHDOG_RUNNING) return watchdog->reason;
+
+    priv_update_memory(watchdog, chip8);
+    if (display_changed || !watchdog->started) {
+        watchdog->display_hash = chip8_display_hash(chip8);
+    }
+    watchdog->started = TRUE;
+
+    if (!inputs_fixed) return WATCHDOG_RUNNING;                                 /* a repeat proves nothing while keys may still change */
+
+    hash = priv_state_hash(watchdog, chip8);
+    seen = priv_find(watchdog->current, hash);
+    if (seen == NULL) {
+        seen = priv_find(watchdog->previous, hash);
+    }
+    if (seen == NULL) {
+        priv_insert(watchdog, hash, chip8->nb_frames);
+        return WATCHDOG_RUNNING;
+    }
+
+    watchdog->since = seen->frame;
+    watchdog->period = chip8->nb_frames - seen->frame;
+    watchdog->pc = chip8->cpu.PC;
+    watchdog->reason = priv_classify(chip8);
+
+    return watchdog->reason;
+}
+
+watchdog_reason_t watchdog_reason(const watchdog_t* watchdog) {
+    return watchdog->reason;
+}
+
+int watchdog_exit_status(const watchdog_t* watchdog) {
+    return watchdog->reason == WATCHDOG_RUNNING ? EXIT_SUCCESS : 1 + watchdog->reason;
+}
+
+void watchdog_print(const watchdog_t* watchdog) {
+    switch (watchdog->reason) {
+        case WATCHDOG_RUNNING:
+            printf("watchdog:      not stuck\n");
+            break;
+        case WATCHDOG_HALTED:
+            printf("watchdog:      halted at 0x%03X since frame %" PRIu64 "\n", watchdog->pc, watchdog->since);
+            break;
+        case WATCHDOG_WAITING_KEY:
+            printf("watchdog:      waiting for a key at 0x%03X since frame %" PRIu64 "\n", watchdog->pc, watchdog->since);
+            break;
+        case WATCHDOG_CYCLE:
+            printf("watchdog:      cycle of %" PRIu64 " frames since frame %" PRIu64 "\n", watchdog->period, watchdog->since);
+            break;
+    }
+}
@@ -0,0 +1,144 @@
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+struct workers {
+    int nb_threads;                         /* helper threads + the calling thread */
+    pthread_t* threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned generation;                    /* bumped for every job */
+    int active;                             /* helpers still working on the job */
+    int quit;
+
+    workers_fn_t fn;
+    void* ctx;
+    size_t count;
+    size_t next;                            /* next index to hand out, atomic */
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_drain(workers_t* workers) {
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&workers->next, 1, __ATOMIC_RELAXED)) < workers->count) {
+        workers->fn(workers->ctx, i);
+    }
+}
+
+static void* priv_thread(void* arg) {
+    workers_t* workers = arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&workers->lock);
+    for (;;) {
+        while (workers->generation == seen && !workers->quit) {
+            pthread_cond_wait(&workers->start, &workers->lock);
+        }
+        if (workers->quit) break;
+
+        seen = workers->generation;
+        pthread_mutex_unlock(&workers->lock);
+
+        priv_drain(workers);
+
+        pthread_mutex_lock(&workers->lock);
+        if (--workers->active == 0) {
+            pthread_cond_signal(&workers->done);
+        }
+    }
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+workers_t* workers_init(int nb_threads) {
+    workers_t* workers;
+
+    if (nb_threads <= 0) {
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_threads = nb_threads > 0 ? nb_threads : 1;
+    }
+
+    workers = calloc(1, sizeof(workers_t));
+    if (workers == NULL) {
+        printf("[ERROR] Cant allocate workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    workers->nb_threads = nb_threads;
+    workers->threads = calloc(nb_threads, sizeof(pthread_t));
+    if (workers->threads == NULL) {
+        printf("[ERROR] Cant allocate workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->start, NULL);
+    pthread_cond_init(&workers->done, NULL);
+
+    for (int i = 1; i < nb_threads; i++) {
+        if (pthread_create(&workers->threads[i], NULL, priv_thread, workers) != 0) {
+            printf("[ERROR] Cant create worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return workers;
+}
+
+void workers_quit(workers_t* workers) {
+    pthread_mutex_lock(&workers->lock);
+    workers->quit = 1;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (int i = 1; i < workers->nb_threads; i++) {
+        pthread_join(workers->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&workers->done);
+    pthread_cond_destroy(&workers->start);
+    pthread_mutex_destroy(&workers->lock);
+
+    free(workers->threads);
+    free(workers);
+}
+
+int workers_count(const workers_t* workers) {
+    return workers->nb_threads;
+}
+
+void workers_run(workers_t* workers, workers_fn_t fn, void* ctx, size_t count) {     /* parallel for, returns once every index is done */
+    pthread_mutex_lock(&workers->lock);
+    workers->fn = fn;
+    workers->ctx = ctx;
+    workers->count = count;
+    workers->next = 0;
+    workers->active = workers->nb_threads - 1;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    priv_drain(workers);                                                        /* the caller takes its share */
+
+    pthread_mutex_lock(&workers->lock);
+    while (workers->active > 0) {
+        pthread_cond_wait(&workers->done, &workers->lock);
+    }
+    pthread_mutex_unlock(&workers->lock);
+}
@@ -0,0 +1,343 @@
+#include "chip8.h"
+#include "search.h"
+#include "vecenv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+
+/*
+ * Benchmark suite, one subcommand per scenario:
+ *
+ *   instances   create N instances of one rom, run them for a few frames,
+ *               then destroy them. Reports the resident memory per instance
+ *               before and after the roms wrote to memory.
+ *   vecenv      step N batched environments with random actions, reports
+ *               the environment steps (frames) per second.
+ *   fork        tree search pattern: a parent plays a while, then each
+ *               round forks N children, runs them a few frames with random
+ *               keys and destroys them. Reports the cost of each part.
+ *
+ * Every scenario runs once per rom given.
+ */
+
+#define BENCH_DEFAULT_INSTANCES  100000
+#define BENCH_DEFAULT_FRAMES     60
+#define BENCH_DEFAULT_ENVS       4096
+#define BENCH_DEFAULT_STEPS      1000
+#define BENCH_DEFAULT_CHILDREN   1024
+#define BENCH_DEFAULT_ROLLOUT    30
+#define BENCH_FORK_ROUNDS        100
+#define BENCH_FORK_WARMUP        300       /* parent frames before the first fork */
+#define BENCH_RNG_SEED           0x2545F491
+
+
+typedef struct bench {
+    char** roms;
+    int nb_roms;
+    int count;
+    int frames;
+    int nb_threads;
+    vecenv_obs_t obs;
+} bench_t;
+
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"count", required_argument, 0, 'n'},
+    {"frames", required_argument, 0, 'f'},
+    {"jobs", required_argument, 0, 'j'},
+    {"bytes", no_argument, 0, 'b'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip8-bench <scenario> [OPTIONS] <rom_path>...\n\n");
+    printf("Scenarios:\n");
+    printf("  instances                Create, run and destroy many instances of the rom.\n");
+    printf("  vecenv                   Step batched environments with random actions.\n");
+    printf("  fork                     Fork a running instance into many children and run them.\n\n");
+    printf("Options:\n");
+    printf("  -n, --count <amount>     Number of instances (default %d, vecenv %d, fork %d).\n", BENCH_DEFAULT_INSTANCES, BENCH_DEFAULT_ENVS, BENCH_DEFAULT_CHILDREN);
+    printf("  -f, --frames <amount>    Frames run by each instance (default %d, vecenv %d, fork %d).\n", BENCH_DEFAULT_FRAMES, BENCH_DEFAULT_STEPS, BENCH_DEFAULT_ROLLOUT);
+    printf("  -j, --jobs <amount>      vecenv and fork threads (default one per core).\n");
+    printf("  -b, --bytes              vecenv byte per pixel observations (default packed).\n");
+    printf("  -h, --help               Display this help message and exit.\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static double priv_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+}
+
+static size_t priv_rss() {                                                      /* resident bytes, from /proc */
+    FILE* file = fopen("/proc/self/statm", "r");
+    unsigned long size, resident = 0;
+
+    if (file == NULL) return 0;
+    if (fscanf(file, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(file);
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static uint16_t priv_random_keys(uint32_t* seed) {                             /* one random key or none, xorshift32 */
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+
+    return (*seed & 0x10) ? 1 << (*seed & 0xF) : 0;
+}
+
+static void priv_instances(const bench_t* bench, const char* rom_path) {
+    chip8_t** instances;
+    size_t rss_start, rss_created, rss_run, nb_pages, footprint = 0;
+    double start, created, run, destroyed;
+    rom_t* rom;
+
+    instances = malloc(bench->count * sizeof(chip8_t*));
+    if (instances == NULL) {
+        printf("[ERROR] Cant allocate instances\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rom = rom_load(rom_path);
+    rss_start = priv_rss();
+
+    start = priv_now();
+    for (int i = 0; i < bench->count; i++) {
+        instances[i] = chip8_create(rom);
+    }
+    created = priv_now();
+    rss_created = priv_rss();
+
+    for (int i = 0; i < bench->count; i++) {
+        for (int f = 0; f < bench->frames; f++) {
+            chip8_run_frame(instances[i], 0);
+        }
+        footprint += chip8_footprint(instances[i]);
+    }
+    run = priv_now();
+    rss_run = priv_rss();
+    nb_pages = pages_used();
+
+    for (int i = 0; i < bench->count; i++) {
+        chip8_destroy(instances[i]);
+    }
+    destroyed = priv_now();
+
+    printf("%s\n", rom_path);
+    printf("instances:          %d\n", bench->count);
+    printf("sizeof(chip8_t):    %zu B\n", sizeof(chip8_t));
+    printf("sizeof(page_t):     %zu B\n", sizeof(page_t));
+    printf("create:             %.1f ns / instance\n", (created - start) * 1.0e9 / bench->count);
+    printf("rss after create:   %.0f B / instance\n", (double)(rss_created - rss_start) / bench->count);
+    printf("run %d frames:      %.2f s\n", bench->frames, run - created);
+    printf("rss after run:      %.0f B / instance\n", (double)(rss_run - rss_start) / bench->count);
+    printf("owned after run:    %.0f B / instance\n", (double)footprint / bench->count);
+    printf("pages in use:       %zu\n", nb_pages);
+    printf("destroy:            %.1f ns / instance\n", (destroyed - run) * 1.0e9 / bench->count);
+
+    rom_release(rom);
+    free(instances);
+}
+
+static void priv_vecenv(const bench_t* bench, const char* rom_path) {
+    vecenv_config_t config = { .nb_envs = bench->count, .nb_threads = bench->nb_threads, .obs = bench->obs, .seed = BENCH_RNG_SEED, .max_frames = 3600, .done_on_halt = TRUE };
+    uint32_t key_seed = BENCH_RNG_SEED;
+    uint64_t nb_dones = 0;
+    uint16_t* actions;
+    uint8_t* dones;
+    uint8_t* obs;
+    double start, elapsed;
+    vecenv_t* env;
+    rom_t* rom;
+
+    rom = rom_load(rom_path);
+    env = vecenv_init(rom, &config);
+    rom_release(rom);
+
+    actions = malloc(bench->count * sizeof(uint16_t));
+    dones = malloc(bench->count);
+    obs = malloc(bench->count * vecenv_obs_size(env));
+    if (actions == NULL || dones == NULL || obs == NULL) {
+        printf("[ERROR] Cant allocate vecenv buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    vecenv_reset(env, obs);
+
+    start = priv_now();
+    for (int step = 0; step < bench->frames; step++) {
+        for (int i = 0; i < bench->count; i++) {
+            actions[i] = priv_random_keys(&key_seed);
+        }
+        vecenv_step(env, actions, obs, dones);
+
+        for (int i = 0; i < bench->count; i++) {
+            nb_dones += dones[i];
+        }
+    }
+    elapsed = priv_now() - start;
+
+    printf("%s\n", rom_path);
+    printf("envs:               %d x %d steps, %s observations\n", bench->count, bench->frames, bench->obs == VECENV_OBS_PACKED ? "packed" : "byte");
+    printf("elapsed:            %.3f s\n", elapsed);
+    printf("env steps:          %.0f / ms\n", (double)bench->count * bench->frames / elapsed / 1000.0);
+    printf("episodes ended:     %" PRIu64 "\n", nb_dones);
+
+    vecenv_quit(env);
+    free(obs);
+    free(dones);
+    free(actions);
+}
+
+static void priv_fork(const bench_t* bench, const char* rom_path) {
+    uint32_t key_seed = BENCH_RNG_SEED;
+    double forking = 0, running = 0, destroying = 0, start, nb_children;
+    size_t nb_owned = 0;
+    chip8_t** children;
+    uint16_t* keys;
+    search_t* search;
+    chip8_t* parent;
+    rom_t* rom;
+
+    children = malloc(bench->count * sizeof(chip8_t*));
+    keys = malloc((size_t)bench->count * bench->frames * sizeof(uint16_t));
+    if (children == NULL || keys == NULL) {
+        printf("[ERROR] Cant allocate fork buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rom = rom_load(rom_path);
+    parent = chip8_create(rom);
+    rom_release(rom);
+    search = search_init(bench->nb_threads);
+
+    parent->rng = BENCH_RNG_SEED;
+    for (int f = 0; f < BENCH_FORK_WARMUP; f++) {
+        chip8_run_frame(parent, priv_random_keys(&key_seed));
+    }
+
+    for (int round = 0; round < BENCH_FORK_ROUNDS; round++) {
+        for (size_t i = 0; i < (size_t)bench->count * bench->frames; i++) {
+            keys[i] = priv_random_keys(&key_seed);
+        }
+
+        start = priv_now();
+        search_fork(parent, children, bench->count, BENCH_RNG_SEED + round);
+        forking += priv_now() - start;
+
+        start = priv_now();
+        search_run(search, children, bench->count, keys, bench->frames);
+        running += priv_now() - start;
+
+        for (int i = 0; i < bench->count; i++) {
+            nb_owned += chip8_footprint(children[i]) - sizeof(chip8_t);
+        }
+
+        start = priv_now();
+        search_destroy(children, bench->count);
+        destroying += priv_now() - start;
+
+        chip8_run_frame(parent, priv_random_keys(&key_seed));                   /* the game moves on */
+    }
+
+    nb_children = (double)bench->count * BENCH_FORK_ROUNDS;
+    printf("%s\n", rom_path);
+    printf("children:           %d x %d rounds, %d frames each\n", bench->count, BENCH_FORK_ROUNDS, bench->frames);
+    printf("fork:               %.1f ns / child\n", forking * 1.0e9 / nb_children);
+    printf("run:                %.0f frames / ms\n", nb_children * bench->frames / running / 1000.0);
+    printf("pages copied:       %.2f / child\n", (double)nb_owned / sizeof(page_t) / nb_children);
+    printf("destroy:            %.1f ns / child\n", destroying * 1.0e9 / nb_children);
+    printf("fork + run + free:  %.0f children / s\n", nb_children / (forking + running + destroying));
+
+    search_quit(search);
+    chip8_destroy(parent);
+    free(keys);
+    free(children);
+}
+
+static int priv_to_int(const char* input) {
+    char* end;
+    long res = strtol(input, &end, 10);
+
+    if (*end != '\0' || res <= 0) {
+        printf("%serror:%s not a number.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    bench_t bench = { .count = 0, .frames = 0 };
+    void (*run)(const bench_t* bench, const char* rom_path) = NULL;
+    const char* scenario;
+    int opt;
+
+    if (argc < 2 || argv[1][0] == '-') {
+        priv_help();
+    }
+    scenario = argv[1];
+    optind = 2;
+
+    while ((opt = getopt_long(argc, argv, "hn:f:j:b", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': bench.count = priv_to_int(optarg); break;
+            case 'f': bench.frames = priv_to_int(optarg); break;
+            case 'j': bench.nb_threads = priv_to_int(optarg); break;
+            case 'b': bench.obs = VECENV_OBS_BYTES; break;
+            default: priv_help(); break;
+        }
+    }
+    if (optind >= argc) {
+        priv_help();
+    }
+    bench.roms = argv + optind;
+    bench.nb_roms = argc - optind;
+
+    if (strcmp(scenario, "instances") == 0) {
+        run = priv_instances;
+        bench.count = bench.count == 0 ? BENCH_DEFAULT_INSTANCES : bench.count;
+        bench.frames = bench.frames == 0 ? BENCH_DEFAULT_FRAMES : bench.frames;
+    } else if (strcmp(scenario, "vecenv") == 0) {
+        run = priv_vecenv;
+        bench.count = bench.count == 0 ? BENCH_DEFAULT_ENVS : bench.count;
+        bench.frames = bench.frames == 0 ? BENCH_DEFAULT_STEPS : bench.frames;
+    } else if (strcmp(scenario, "fork") == 0) {
+        run = priv_fork;
+        bench.count = bench.count == 0 ? BENCH_DEFAULT_CHILDREN : bench.count;
+        bench.frames = bench.frames == 0 ? BENCH_DEFAULT_ROLLOUT : bench.frames;
+    } else {
+        priv_help();
+    }
+
+    for (int i = 0; i < bench.nb_roms; i++) {
+        if (i > 0) printf("\n");
+        run(&bench, bench.roms[i]);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,74 @@
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+
+/*
+ * chip-8d, hosts emulator sessions for clients of a Unix domain socket, see
+ * include/server.h for the protocol and tools/load.c for a client.
+ */
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"socket", required_argument, 0, 's'},
+    {"jobs", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip-8d [OPTIONS]\n\n");
+    printf("Options:\n");
+    printf("  -s, --socket <path>      Socket to listen on (default %s).\n", SERVER_DEFAULT_PATH);
+    printf("  -j, --jobs <amount>      Threads stepping the sessions (default one per core).\n");
+    printf("  -h, --help               Display this help message and exit.\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static int priv_to_int(const char* input) {
+    char* end;
+    long res = strtol(input, &end, 10);
+
+    if (*end != '\0' || res <= 0) {
+        printf("%serror:%s not a number.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    const char* path = SERVER_DEFAULT_PATH;
+    int nb_threads = 0;
+    server_t* server;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "hs:j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'j': nb_threads = priv_to_int(optarg); break;
+            default: priv_help(); break;
+        }
+    }
+
+    server = server_init(path, nb_threads);
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    server_main_loop(server);
+    server_quit(server);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,358 @@
+#include "chip8.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+
+/*
+ * Lockstep differential testing between execution engines.
+ *
+ * Every rom runs twice, on the reference interpreter and on the engine under
+ * test, with the same rng seed and the same pseudo random key presses. After
+ * each block retired by the engine, the reference catches up by the same
+ * number of instructions and both states are compared. Memory and display
+ * are compared when the block stored to memory or changed the display
+ * (written_pages, display_dirty), and fully at every frame.
+ */
+
+#define DIFF_DEFAULT_FRAMES   600
+#define DIFF_DEFAULT_HISTORY  16
+#define DIFF_HISTORY_MAX      256
+#define DIFF_RNG_SEED         0x2545F491
+#define DIFF_MAX_REPORTED     16
+
+
+typedef struct engine_entry {
+    const char* name;
+    chip8_engine_t step;
+} engine_entry_t;
+
+typedef struct history {
+    uint16_t PC, opcode;
+} history_t;
+
+typedef struct diff {
+    chip8_engine_t step;
+    int variant;                            /* -1 to pick it from each rom extension */
+    int frames;
+    int history;
+    char** roms;
+
+    char** reports;
+    int nb_diverged, nb_skipped;
+} diff_t;
+
+
+static const engine_entry_t engines[] = {
+    { "reference", chip8_engine_reference },
+    { "fused", chip8_engine_fused },
+};
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"engine", required_argument, 0, 'e'},
+    {"variant", required_argument, 0, 'v'},
+    {"frames", required_argument, 0, 'f'},
+    {"history", required_argument, 0, 'n'},
+    {"jobs", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip8-diff [OPTIONS] <rom_path>...\n\n");
+    printf("Options:\n");
+    printf("  -e, --engine <name>      Engine to check against the reference (default reference).\n");
+    printf("  -v, --variant <name>     chip8, schip or xochip (default from the rom extension .sc8 / .xo8, else chip8).\n");
+    printf("  -f, --frames <amount>    Frames to run per rom (default %d).\n", DIFF_DEFAULT_FRAMES);
+    printf("  -n, --history <amount>   Opcodes to show on divergence (default %d).\n", DIFF_DEFAULT_HISTORY);
+    printf("  -j, --jobs <amount>      Roms checked in parallel (default one per core).\n");
+    printf("  -h, --help               Display this help message and exit.\n\n");
+    printf("Engines:");
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        printf(" %s", engines[i].name);
+    }
+    printf("\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static variant_t priv_to_variant(const char* input) {
+    if (strcmp(input, "chip8") == 0) return VARIANT_CHIP8;
+    if (strcmp(input, "schip") == 0) return VARIANT_SCHIP;
+    if (strcmp(input, "xochip") == 0) return VARIANT_XOCHIP;
+
+    printf("%serror:%s unknown variant, expected chip8, schip or xochip.\n", "\033[1;31m", "\033[0m");
+    exit(EXIT_FAILURE);
+}
+
+static variant_t priv_variant_from_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+
+    if (ext != NULL && strcmp(ext, ".sc8") == 0) return VARIANT_SCHIP;
+    if (ext != NULL && strcmp(ext, ".xo8") == 0) return VARIANT_XOCHIP;
+    return VARIANT_CHIP8;
+}
+
+static void priv_clear_written(chip8_t* chip8) {                                /* see priv_touched() */
+    chip8->written_pages = 0;
+    chip8->display_dirty = FALSE;
+}
+
+static int priv_touched(const chip8_t* chip8) {                                 /* stored to memory or changed the display since priv_clear_written() */
+    return chip8->written_pages != 0 || chip8->display_dirty;
+}
+
+static const char* priv_compare_cpu(const chip8_t* a, const chip8_t* b) {
+    if (memcmp(a->cpu.V, b->cpu.V, NB_REGISTER) != 0) return "V registers";
+    if (a->cpu.PC != b->cpu.PC) return "PC";
+    if (a->cpu.I != b->cpu.I) return "I";
+    if (a->cpu.SP != b->cpu.SP) return "SP";
+    if (a->cpu.DT != b->cpu.DT || a->cpu.ST != b->cpu.ST) return "timers";
+    if (memcmp(a->cpu.stack, b->cpu.stack, sizeof(a->cpu.stack)) != 0) return "stack";
+    if (a->wait_next_frame != b->wait_next_frame) return "wait_next_frame";
+    if (a->rng != b->rng) return "rng state";
+    if (a->display_mode.width != b->display_mode.width || a->planes != b->planes) return "display mode";
+    if (a->ext != NULL && memcmp(a->ext->flags, b->ext->flags, NB_FLAGS) != 0) return "flags";
+    return NULL;
+}
+
+static const char* priv_compare_memory(const chip8_t* a, const chip8_t* b) {
+    for (int i = 0; i < chip8_nb_pages(a); i++) {
+        if (a->pages[i] != b->pages[i] && memcmp(a->pages[i]->data, b->pages[i]->data, PAGE_SIZE) != 0) return "memory";
+    }
+    if (memcmp(a->display, b->display, chip8_display_size(a)) != 0) return "display";
+    return NULL;
+}
+
+static void priv_dump_cpu(FILE* out, const char* name, const chip8_t* chip8) {
+    const cpu_t* cpu = &chip8->cpu;
+
+    fprintf(out, "  %-10s PC=%04X I=%04X SP=%X DT=%02X ST=%02X wait=%d V=", name, cpu->PC, cpu->I, cpu->SP, cpu->DT, cpu->ST, chip8->wait_next_frame);
+    for (size_t i = 0; i < NB_REGISTER; i++) {
+        fprintf(out, "%02X", cpu->V[i]);
+    }
+    fprintf(out, "\n");
+}
+
+static void priv_dump(FILE* out, const diff_t* diff, const chip8_t* ref, const chip8_t* alt, const history_t* history, long nb_executed) {
+    int reported = 0, pixels = 0;
+
+    priv_dump_cpu(out, "reference", ref);
+    priv_dump_cpu(out, "engine", alt);
+
+    for (size_t i = 0; i < (size_t)ref->memory_mask + 1 && reported < DIFF_MAX_REPORTED; i++) {
+        if (chip8_read(ref, i) != chip8_read(alt, i)) {
+            fprintf(out, "  memory[%04zX] reference=%02X engine=%02X\n", i, chip8_read(ref, i), chip8_read(alt, i));
+            reported++;
+        }
+    }
+    for (size_t i = 0; i < DISPLAY_WORDS(ref->display_mode); i++) {
+        pixels += __builtin_popcountll(ref->display[i] ^ alt->display[i]);
+    }
+    if (pixels > 0) {
+        fprintf(out, "  display: %d pixels differ\n", pixels);
+    }
+
+    fprintf(out, "  last opcodes (oldest first):\n");
+    for (long i = nb_executed - diff->history; i < nb_executed; i++) {
+        if (i < 0) continue;
+        const history_t* h = &history[i % DIFF_HISTORY_MAX];
+        fprintf(out, "    %04X: %04X\n", h->PC, h->opcode);
+    }
+}
+
+static chip8_t* priv_create(rom_t* rom, variant_t variant) {
+    static const int ips[] = {
+        [VARIANT_CHIP8] = DEFAULT_UPDATE_RATE_CHIP8,
+        [VARIANT_SCHIP] = DEFAULT_UPDATE_RATE_SCHIP,
+        [VARIANT_XOCHIP] = DEFAULT_UPDATE_RATE_XOCHIP,
+    };
+    chip8_t* chip8 = chip8_create(rom);
+
+    if (variant != VARIANT_CHIP8) {
+        chip8_set_variant(chip8, variant);
+    }
+    chip8->ips = ips[variant];
+    chip8->rng = DIFF_RNG_SEED;
+
+    return chip8;
+}
+
+static uint16_t priv_next_keys(uint32_t* seed, int frame, uint16_t keys) {   /* hold a random key (or none) for 8 frames */
+    uint32_t x = *seed;
+
+    if (frame % 8 != 0) return keys;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+
+    return (x & 0x10) ? 1 << (x & 0xF) : 0;
+}
+
+static int priv_run(FILE* out, const diff_t* diff, chip8_t* ref, chip8_t* alt) {
+    history_t history[DIFF_HISTORY_MAX];
+    uint32_t key_seed = DIFF_RNG_SEED;
+    uint16_t keys = 0;
+    long nb_executed = 0;
+    const char* what;
+
+    for (int frame = 0; frame < diff->frames; frame++) {
+        int budget = ref->ips / UPDATE_RATE_60HZ;
+        int done = 0;
+
+        while (done < budget && !ref->wait_next_frame) {
+            int retired;
+
+            priv_clear_written(ref);
+            priv_clear_written(alt);
+            retired = diff->step(alt, budget - done);
+
+            for (int i = 0; i < retired; i++) {
+                history_t* h = &history[nb_executed++ % DIFF_HISTORY_MAX];
+
+                h->PC = ref->cpu.PC;
+                h->opcode = chip8_fetch(ref, ref->cpu.PC);
+                chip8_engine_reference(ref, 1);
+            }
+            done += retired;
+
+            what = priv_compare_cpu(ref, alt);
+            if (what == NULL && (priv_touched(ref) || priv_touched(alt))) {
+                what = priv_compare_memory(ref, alt);
+            }
+            if (what != NULL) {
+                fprintf(out, "DIVERGED frame %d, instruction %ld: %s\n", frame, nb_executed, what);
+                priv_dump(out, diff, ref, alt, history, nb_executed);
+                return FALSE;
+            }
+            if (retired <= 0) break;
+        }
+
+        keys = priv_next_keys(&key_seed, frame, keys);
+        chip8_next_frame(ref, keys);
+        chip8_next_frame(alt, keys);
+
+        if ((what = priv_compare_cpu(ref, alt)) != NULL || (what = priv_compare_memory(ref, alt)) != NULL) {
+            fprintf(out, "DIVERGED end of frame %d: %s\n", frame, what);
+            priv_dump(out, diff, ref, alt, history, nb_executed);
+            return FALSE;
+        }
+    }
+
+    fprintf(out, "ok (%ld instructions)\n", nb_executed);
+    return TRUE;
+}
+
+static void priv_diff_rom(void* ctx, size_t index) {
+    diff_t* diff = ctx;
+    variant_t variant = diff->variant >= 0 ? (variant_t)diff->variant : priv_variant_from_path(diff->roms[index]);
+    size_t max_len = variant == VARIANT_XOCHIP ? MEMORY_MAX_SIZE - ROM_START_ADR : MEMORY_SIZE - ROM_START_ADR;
+    uint8_t buffer[MEMORY_MAX_SIZE];
+    size_t len, report_len;
+    chip8_t *ref, *alt;
+    rom_t* rom;
+    FILE* out;
+
+    out = open_memstream(&diff->reports[index], &report_len);
+    fprintf(out, "%s: ", diff->roms[index]);
+
+    if (!read_file(diff->roms[index], buffer, max_len, &len)) {
+        fprintf(out, "skipped, cant load rom\n");
+        __atomic_add_fetch(&diff->nb_skipped, 1, __ATOMIC_RELAXED);
+        fclose(out);
+        return;
+    }
+
+    rom = rom_create(buffer, len);                                              /* both instances share the rom pages */
+    ref = priv_create(rom, variant);
+    alt = priv_create(rom, variant);
+    rom_release(rom);
+
+    if (!priv_run(out, diff, ref, alt)) {
+        __atomic_add_fetch(&diff->nb_diverged, 1, __ATOMIC_RELAXED);
+    }
+
+    chip8_destroy(ref);
+    chip8_destroy(alt);
+    fclose(out);
+}
+
+static int priv_to_int(const char* input) {
+    char* end;
+    long res = strtol(input, &end, 10);
+
+    if (*end != '\0' || res < 0) {
+        printf("%serror:%s not a number.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    diff_t diff = { .step = chip8_engine_reference, .variant = -1, .frames = DIFF_DEFAULT_FRAMES, .history = DIFF_DEFAULT_HISTORY };
+    const char* engine = "reference";
+    workers_t* workers;
+    int nb_jobs = 0, nb_roms, opt;
+
+    while ((opt = getopt_long(argc, argv, "he:v:f:n:j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'e': engine = optarg; break;
+            case 'v': diff.variant = priv_to_variant(optarg); break;
+            case 'f': diff.frames = priv_to_int(optarg); break;
+            case 'n': diff.history = priv_to_int(optarg); break;
+            case 'j': nb_jobs = priv_to_int(optarg); break;
+            default: priv_help(); break;
+        }
+    }
+
+    diff.step = NULL;
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i].name, engine) == 0) {
+            diff.step = engines[i].step;
+        }
+    }
+    if (diff.step == NULL || optind >= argc) {
+        priv_help();
+    }
+    if (diff.history > DIFF_HISTORY_MAX) {
+        diff.history = DIFF_HISTORY_MAX;
+    }
+
+    diff.roms = argv + optind;
+    nb_roms = argc - optind;
+    diff.reports = calloc(nb_roms, sizeof(char*));
+    if (diff.reports == NULL) {
+        printf("[ERROR] Cant allocate reports\n");
+        exit(EXIT_FAILURE);
+    }
+
+    workers = workers_init(nb_jobs);
+    workers_run(workers, priv_diff_rom, &diff, nb_roms);
+    workers_quit(workers);
+
+    for (int i = 0; i < nb_roms; i++) {                                         /* reports in argument order */
+        fputs(diff.reports[i], stdout);
+        free(diff.reports[i]);
+    }
+    free(diff.reports);
+
+    printf("%d roms, engine %s: %d diverged, %d skipped\n", nb_roms, engine, diff.nb_diverged, diff.nb_skipped);
+
+    exit(diff.nb_diverged == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
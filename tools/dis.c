@@ -0,0 +1,357 @@
+#include "analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+
+
+/*
+ * Annotated disassembly of a rom from the static analysis, see analysis.h.
+ * Blocks get a label (sub_XXX for CALL targets, L_XXX otherwise), bytes
+ * read by DXYn / FX65 are drawn as sprite rows, bytes the walk never reached
+ * are dumped as db, and code that FX33 / FX55 stores to is marked.
+ */
+
+#define DB_PER_LINE  8
+
+
+typedef struct listing {
+    const rom_t* rom;
+    const analysis_t* analysis;
+    uint16_t mask;
+} listing_t;
+
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"variant", required_argument, 0, 'v'},
+    {"no-cache", no_argument, 0, 'n'},
+    {"summary", no_argument, 0, 'S'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip8-dis [OPTIONS] <rom_file>\n\n");
+    printf("Options:\n");
+    printf("  -v, --variant <name>     chip8, schip or xochip (default from the rom extension .sc8 / .xo8, else chip8).\n");
+    printf("  -n, --no-cache           Analyse the rom again, do not read or write the block cache.\n");
+    printf("  -S, --summary            Only print the summary.\n");
+    printf("  -h, --help               Display this help message and exit.\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static variant_t priv_to_variant(const char* input) {
+    if (strcmp(input, "chip8") == 0) return VARIANT_CHIP8;
+    if (strcmp(input, "schip") == 0) return VARIANT_SCHIP;
+    if (strcmp(input, "xochip") == 0) return VARIANT_XOCHIP;
+
+    printf("%serror:%s unknown variant, expected chip8, schip or xochip.\n", "\033[1;31m", "\033[0m");
+    exit(EXIT_FAILURE);
+}
+
+static variant_t priv_variant_from_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+
+    if (ext != NULL && strcmp(ext, ".sc8") == 0) return VARIANT_SCHIP;
+    if (ext != NULL && strcmp(ext, ".xo8") == 0) return VARIANT_XOCHIP;
+    return VARIANT_CHIP8;
+}
+
+static const char* priv_variant_name(variant_t variant) {
+    switch (variant) {
+        case VARIANT_SCHIP: return "schip";
+        case VARIANT_XOCHIP: return "xochip";
+        default: return "chip8";
+    }
+}
+
+static double priv_now_us() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint8_t priv_byte(const listing_t* listing, uint32_t addr) {
+    addr &= listing->mask;
+    return rom_page(listing->rom, addr >> PAGE_SHIFT)->data[addr & PAGE_MASK];
+}
+
+static uint16_t priv_word(const listing_t* listing, uint32_t addr) {
+    return (priv_byte(listing, addr) << 8) | priv_byte(listing, addr + 1);
+}
+
+static void priv_label(const listing_t* listing, uint16_t addr, char* label, size_t len) {    /* label of a block start, else the bare address */
+    uint8_t flags = listing->analysis->flags[addr & listing->mask];
+
+    if (flags & ANALYSIS_CALLED) {
+        snprintf(label, len, "sub_%03X", addr);
+    } else if ((flags & ANALYSIS_LEADER) && (flags & ANALYSIS_CODE)) {
+        snprintf(label, len, "L_%03X", addr);
+    } else {
+        snprintf(label, len, "0x%03X", addr);
+    }
+}
+
+static void priv_mnemonic(const listing_t* listing, uint16_t pc, char* text, size_t len) {
+    variant_t variant = listing->analysis->variant;
+    uint16_t opcode = priv_word(listing, pc);
+    uint8_t X = (opcode >> 8) & 0xF, Y = (opcode >> 4) & 0xF, n = opcode & 0xF, kk = opcode & 0xFF;
+    uint16_t nnn = opcode & 0x0FFF;
+    char label[16];
+    static const char* const alu[16] = {
+        "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+        NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL,
+    };
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) { snprintf(text, len, "CLS"); return; }
+            if (opcode == 0x00EE) { snprintf(text, len, "RET"); return; }
+            if (variant != VARIANT_CHIP8) {
+                if ((opcode & 0xFFF0) == 0x00C0) { snprintf(text, len, "SCD   %d", n); return; }
+                if ((opcode & 0xFFF0) == 0x00D0 && variant == VARIANT_XOCHIP) { snprintf(text, len, "SCU   %d", n); return; }
+                if (opcode == 0x00FB) { snprintf(text, len, "SCR"); return; }
+                if (opcode == 0x00FC) { snprintf(text, len, "SCL"); return; }
+                if (opcode == 0x00FD) { snprintf(text, len, "EXIT"); return; }
+                if (opcode == 0x00FE) { snprintf(text, len, "LOW"); return; }
+                if (opcode == 0x00FF) { snprintf(text, len, "HIGH"); return; }
+            }
+            snprintf(text, len, "SYS   0x%03X", nnn);
+            return;
+        case 0x1:
+            priv_label(listing, nnn, label, sizeof(label));
+            snprintf(text, len, "JP    %s", label);
+            return;
+        case 0x2:
+            priv_label(listing, nnn, label, sizeof(label));
+            snprintf(text, len, "CALL  %s", label);
+            return;
+        case 0x3: snprintf(text, len, "SE    V%X, 0x%02X", X, kk); return;
+        case 0x4: snprintf(text, len, "SNE   V%X, 0x%02X", X, kk); return;
+        case 0x5:
+            if (n == 0) { snprintf(text, len, "SE    V%X, V%X", X, Y); return; }
+            if (n == 2 && variant == VARIANT_XOCHIP) { snprintf(text, len, "LD    [I], V%X-V%X", X, Y); return; }
+            if (n == 3 && variant == VARIANT_XOCHIP) { snprintf(text, len, "LD    V%X-V%X, [I]", X, Y); return; }
+            break;
+        case 0x6: snprintf(text, len, "LD    V%X, 0x%02X", X, kk); return;
+        case 0x7: snprintf(text, len, "ADD   V%X, 0x%02X", X, kk); return;
+        case 0x8:
+            if (alu[n] != NULL) { snprintf(text, len, "%-5s V%X, V%X", alu[n], X, Y); return; }
+            break;
+        case 0x9:
+            if (n == 0) { snprintf(text, len, "SNE   V%X, V%X", X, Y); return; }
+            break;
+        case 0xA: snprintf(text, len, "LD    I, 0x%03X", nnn); return;
+        case 0xB:
+            if (variant == VARIANT_SCHIP) { snprintf(text, len, "JP    V%X, 0x%03X", X, nnn); return; }
+            snprintf(text, len, "JP    V0, 0x%03X", nnn);
+            return;
+        case 0xC: snprintf(text, len, "RND   V%X, 0x%02X", X, kk); return;
+        case 0xD: snprintf(text, len, "DRW   V%X, V%X, %d", X, Y, n); return;
+        case 0xE:
+            if (kk == 0x9E) { snprintf(text, len, "SKP   V%X", X); return; }
+            if (kk == 0xA1) { snprintf(text, len, "SKNP  V%X", X); return; }
+            break;
+        case 0xF:
+            if (variant == VARIANT_XOCHIP) {
+                if (opcode == 0xF000) { snprintf(text, len, "LD    I, 0x%04X", priv_word(listing, pc + 2)); return; }
+                if (kk == 0x01) { snprintf(text, len, "PLANE %d", X); return; }
+                if (opcode == 0xF002) { snprintf(text, len, "AUDIO"); return; }
+                if (kk == 0x3A) { snprintf(text, len, "PITCH V%X", X); return; }
+            }
+            if (variant != VARIANT_CHIP8) {
+                if (kk == 0x30) { snprintf(text, len, "LD    HF, V%X", X); return; }
+                if (kk == 0x75) { snprintf(text, len, "LD    R, V%X", X); return; }
+                if (kk == 0x85) { snprintf(text, len, "LD    V%X, R", X); return; }
+            }
+            switch (kk) {
+                case 0x07: snprintf(text, len, "LD    V%X, DT", X); return;
+                case 0x0A: snprintf(text, len, "LD    V%X, K", X); return;
+                case 0x15: snprintf(text, len, "LD    DT, V%X", X); return;
+                case 0x18: snprintf(text, len, "LD    ST, V%X", X); return;
+                case 0x1E: snprintf(text, len, "ADD   I, V%X", X); return;
+                case 0x29: snprintf(text, len, "LD    F, V%X", X); return;
+                case 0x33: snprintf(text, len, "LD    B, V%X", X); return;
+                case 0x55: snprintf(text, len, "LD    [I], V%X", X); return;
+                case 0x65: snprintf(text, len, "LD    V%X, [I]", X); return;
+                default: break;
+            }
+            break;
+    }
+
+    snprintf(text, len, "???");
+}
+
+static uint32_t priv_instruction(const listing_t* listing, uint32_t pc) {      /* returns the bytes printed */
+    const uint8_t* flags = listing->analysis->flags;
+    uint32_t len = listing->analysis->variant == VARIANT_XOCHIP && priv_word(listing, pc) == 0xF000 ? 4 : 2;
+    const char* comment = NULL;
+    uint8_t seen = 0;
+    char text[64], label[16];
+
+    if (flags[pc] & ANALYSIS_LEADER) {
+        priv_label(listing, pc, label, sizeof(label));
+        printf("\n%s:\n", label);
+    }
+    priv_mnemonic(listing, pc, text, sizeof(text));
+
+    for (uint32_t i = 0; i < len; i++) {
+        seen |= flags[(pc + i) & listing->mask];
+    }
+    if (flags[pc] & ANALYSIS_INDIRECT) {
+        comment = "indirect, target known at run time";
+    } else if (seen & ANALYSIS_WRITTEN) {
+        comment = "self-modifying, stored to by FX33 / FX55";
+    } else if (seen & ANALYSIS_DATA) {
+        comment = "also read as data";
+    }
+
+    if (len == 4) {
+        printf("  %03X: %04X %04X  ", pc, priv_word(listing, pc), priv_word(listing, pc + 2));
+    } else {
+        printf("  %03X: %04X       ", pc, priv_word(listing, pc));
+    }
+    if (comment != NULL) {
+        printf("%-20s  ; %s\n", text, comment);
+    } else {
+        printf("%s\n", text);
+    }
+
+    return len;
+}
+
+static void priv_sprite_row(uint32_t addr, uint8_t byte) {
+    char row[9];
+
+    for (int i = 0; i < 8; i++) {
+        row[i] = (byte >> (7 - i)) & 1 ? '#' : '.';
+    }
+    row[8] = '\0';
+    printf("  %03X: %02X         %s\n", addr, byte, row);
+}
+
+static uint32_t priv_db(const listing_t* listing, uint32_t addr, uint32_t end) {   /* unreached bytes, returns the count printed */
+    uint32_t nb = 0;
+
+    printf("  %03X: db", addr);
+    while (nb < DB_PER_LINE && addr + nb < end && listing->analysis->flags[addr + nb] == 0) {
+        printf("%s0x%02X", nb == 0 ? " " : ", ", priv_byte(listing, addr + nb));
+        nb++;
+    }
+    printf("\n");
+
+    return nb;
+}
+
+static void priv_listing(const listing_t* listing) {
+    const analysis_t* analysis = listing->analysis;
+    uint32_t end = ROM_START_ADR + analysis->rom_len;
+
+    for (uint32_t i = 0; i < analysis->nb_blocks; i++) {                        /* code jumped to past the rom */
+        uint32_t block_end = analysis->blocks[i].end > analysis->blocks[i].start ? analysis->blocks[i].end : analysis->memory_size;
+
+        if (block_end > end) {
+            end = block_end;
+        }
+    }
+    if (end > analysis->memory_size) {
+        end = analysis->memory_size;
+    }
+
+    for (uint32_t addr = ROM_START_ADR; addr < end;) {
+        uint8_t flags = analysis->flags[addr];
+
+        if (flags & ANALYSIS_CODE) {
+            addr += priv_instruction(listing, addr);
+        } else if (flags & (ANALYSIS_DATA | ANALYSIS_WRITTEN)) {
+            priv_sprite_row(addr, priv_byte(listing, addr));
+            addr++;
+        } else if (flags & ANALYSIS_OPERAND) {                                  /* tail of an instruction decoded at an odd offset */
+            addr++;
+        } else {
+            addr += priv_db(listing, addr, end);
+        }
+    }
+}
+
+static void priv_summary(const char* path, const listing_t* listing, double elapsed_us) {
+    const analysis_t* analysis = listing->analysis;
+    uint32_t code = 0, data = 0, modified = 0, unreached = 0, indirect = 0, subs = 0;
+
+    for (uint32_t i = 0; i < analysis->memory_size; i++) {
+        uint8_t flags = analysis->flags[i];
+
+        code += (flags & (ANALYSIS_CODE | ANALYSIS_OPERAND)) != 0;
+        data += (flags & ANALYSIS_DATA) && !(flags & (ANALYSIS_CODE | ANALYSIS_OPERAND));
+        modified += (flags & (ANALYSIS_CODE | ANALYSIS_OPERAND)) && (flags & ANALYSIS_WRITTEN);
+        indirect += (flags & ANALYSIS_INDIRECT) != 0;
+        subs += (flags & ANALYSIS_CALLED) != 0;
+        if (i >= ROM_START_ADR && i < ROM_START_ADR + analysis->rom_len) {
+            unreached += flags == 0;
+        }
+    }
+
+    printf("; %s\n", path);
+    printf("; %s, %zu bytes, hash %016" PRIx64 "\n", priv_variant_name(analysis->variant), analysis->rom_len, analysis->rom_hash);
+    printf("; %u blocks, %u subroutines, %u indirect jumps\n", analysis->nb_blocks, subs, indirect);
+    printf("; %u bytes of code, %u of data, %u unreached, %u self-modifying\n", code, data, unreached, modified);
+    printf("; %s in %.1f us\n", analysis->from_cache ? "cache hit" : "analysed", elapsed_us);
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    int variant = -1, no_cache = FALSE, summary_only = FALSE;
+    analysis_t* analysis;
+    listing_t listing;
+    double start;
+    rom_t* rom;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "hv:nS", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'v': variant = priv_to_variant(optarg); break;
+            case 'n': no_cache = TRUE; break;
+            case 'S': summary_only = TRUE; break;
+            default: priv_help(); break;
+        }
+    }
+    if (optind != argc - 1) {
+        priv_help();
+    }
+    if (variant < 0) {
+        variant = priv_variant_from_path(argv[optind]);
+    }
+
+    rom = rom_load(argv[optind]);
+
+    start = priv_now_us();
+    analysis = no_cache ? analysis_run(rom, variant) : analysis_load(rom, variant);
+
+    listing.rom = rom;
+    listing.analysis = analysis;
+    listing.mask = analysis->memory_size - 1;
+
+    priv_summary(argv[optind], &listing, priv_now_us() - start);
+    if (!summary_only) {
+        priv_listing(&listing);
+    }
+
+    analysis_free(analysis);
+    rom_release(rom);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,186 @@
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * Fuzz target for the cpu core.
+ *
+ * Input layout:
+ *   [0]                 variant (bits 6-7, 0 chip8, 1 schip, 2 and 3 xochip)
+ *                       and quirks flipped from its defaults (bits 0-5)
+ *   [1]                 number of key script entries K
+ *   [2 .. 2 + 3K]       K entries of { frame, keys low, keys high }
+ *   [2 + 3K .. end]     rom loaded at ROM_START_ADR, up to 64 KB on XO-CHIP
+ *
+ * Build with `make libfuzzer` for libFuzzer, or `CC=afl-clang-fast make fuzz`
+ * for AFL (persistent mode). The plain `make fuzz` binary replays inputs
+ * given as arguments, or read from stdin.
+ *
+ * Besides the compiler coverage, every executed branch opcode records a
+ * (PC, next PC) edge so the fuzzer also explores rom behaviour. The edges
+ * go to libFuzzer extra counters, or to a plain array otherwise.
+ */
+
+#define FUZZ_MAX_FRAMES         64
+#define FUZZ_MAX_INSTRUCTIONS   1024
+#define FUZZ_MAX_KEY_ENTRIES    32
+#define FUZZ_RNG_SEED           0x2545F491
+#define FUZZ_COVERAGE_SIZE      4096
+
+
+#if defined(CHIP8_LIBFUZZER)
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t rom_coverage[FUZZ_COVERAGE_SIZE];
+
+static rom_t* rom;                                                              /* refilled in place by every run */
+static chip8_t* instances[VARIANT_XOCHIP + 1];                                  /* one per variant, reused between runs */
+static uint8_t default_quirks[VARIANT_XOCHIP + 1];
+static chip8_t* chip8;                                                          /* the one running the current input */
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static int priv_is_branch(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0: return opcode == 0x00EE;                                      /* RET */
+        case 0x1: case 0x2: case 0xB:                                           /* JMP, CALL, JP V0 */
+        case 0x3: case 0x4: case 0x5: case 0x9:                                 /* skips */
+        case 0xE:                                                               /* SKP, SKNP */
+            return TRUE;
+        case 0xF: return (opcode & 0xFF) == 0x0A;                               /* LD Vx, K loops on itself */
+        default: return FALSE;
+    }
+}
+
+static void priv_record_edge(uint16_t from, uint16_t to) {
+    uint32_t edge = ((uint32_t)(from & chip8->memory_mask) << 1) ^ (to & chip8->memory_mask);
+
+    edge = (edge * 0x9E3779B1u) >> 20;                                          /* fibonacci hash to 12 bits */
+    if (rom_coverage[edge] != 0xFF) {
+        rom_coverage[edge]++;
+    }
+}
+
+static void priv_init() {
+    uint8_t empty[1] = { 0 };
+
+    rom = rom_create(empty, 0);
+    for (int i = 0; i <= VARIANT_XOCHIP; i++) {
+        instances[i] = chip8_create(rom);
+        if (i != VARIANT_CHIP8) {
+            chip8_set_variant(instances[i], i);
+        }
+        default_quirks[i] = instances[i]->quirks;
+    }
+}
+
+static void priv_load(uint8_t config, const uint8_t* data, size_t size) {      /* every instance is reset before it runs again */
+    static const variant_t variants[] = { VARIANT_CHIP8, VARIANT_SCHIP, VARIANT_XOCHIP, VARIANT_XOCHIP };
+    variant_t variant = variants[config >> 6];
+    size_t max_size = variant == VARIANT_XOCHIP ? MEMORY_MAX_SIZE - ROM_START_ADR : MEMORY_SIZE - ROM_START_ADR;
+
+    if (size > max_size) {
+        size = max_size;
+    }
+
+    chip8 = instances[variant];
+    rom_refill(rom, data, size);
+    chip8_reset(chip8);
+    chip8->quirks = default_quirks[variant] ^ (config & 0x3F);
+    if (chip8->ext != NULL) {                                                   /* FX75 flags outlive a reset, not an input */
+        memset(chip8->ext->flags, 0, NB_FLAGS);
+    }
+}
+
+static void priv_run(const uint8_t* data, size_t size) {
+    size_t nb_keys, key_idx = 0;
+    const uint8_t* keys;
+    uint16_t key_state = 0;
+    int executed = 0;
+
+    if (size < 2) return;
+
+    nb_keys = data[1] > FUZZ_MAX_KEY_ENTRIES ? FUZZ_MAX_KEY_ENTRIES : data[1];
+    if (size < 2 + nb_keys * 3) return;
+
+    keys = data + 2;
+    if (rom == NULL) {
+        priv_init();
+    }
+    priv_load(data[0], data + 2 + nb_keys * 3, size - 2 - nb_keys * 3);
+    chip8->rng = FUZZ_RNG_SEED;
+
+    for (int frame = 0; frame < FUZZ_MAX_FRAMES && executed < FUZZ_MAX_INSTRUCTIONS; ++frame) {
+        int budget = chip8->ips / UPDATE_RATE_60HZ;
+
+        for (int i = 0; i < budget && !chip8->wait_next_frame; ++i, ++executed) {
+            uint16_t pc = chip8->cpu.PC;
+            uint16_t opcode = chip8_fetch(chip8, pc);
+
+            chip8_step(chip8);
+            if (priv_is_branch(opcode)) {
+                priv_record_edge(pc, chip8->cpu.PC);
+            }
+        }
+
+        while (key_idx < nb_keys && keys[key_idx * 3] <= frame) {               /* apply every key change due this frame */
+            key_state = keys[key_idx * 3 + 1] | (keys[key_idx * 3 + 2] << 8);
+            key_idx++;
+        }
+        chip8_next_frame(chip8, key_state);
+    }
+}
+
+
+/******************************************************
+ *                 Public functions                   *
+ ******************************************************/
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    priv_run(data, size);
+
+    return 0;
+}
+
+#if !defined(CHIP8_LIBFUZZER)
+
+static uint8_t input[MEMORY_MAX_SIZE];                                          /* header and the largest XO-CHIP rom */
+
+static void priv_run_file(FILE* file) {
+    size_t len = fread(input, sizeof(uint8_t), sizeof(input), file);
+
+    LLVMFuzzerTestOneInput(input, len);
+}
+
+int main(int argc, char* argv []) {
+    if (argc > 1) {                                                             /* replay crashes / corpus entries */
+        for (int i = 1; i < argc; i++) {
+            FILE* file = fopen(argv[i], "rb");
+            if (file == NULL) {
+                printf("[ERROR] Cant open input file: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            priv_run_file(file);
+            fclose(file);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+#if defined(__AFL_LOOP)
+    while (__AFL_LOOP(100000)) {
+        priv_run_file(stdin);
+    }
+#else
+    priv_run_file(stdin);
+#endif
+
+    exit(EXIT_SUCCESS);
+}
+
+#endif /* CHIP8_LIBFUZZER */
@@ -0,0 +1,407 @@
+#include "chip8.h"
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/*
+ * Load generator for chip-8d, one connection, every phase once per rom:
+ *
+ *   create      N sessions in one batch, then single CREATE batches for the
+ *               round trip latency.
+ *   hash        batches of one HASH (fixed cost of a batch) and of N HASH
+ *               (cost of each request on top), no emulation involved.
+ *   step        rounds of KEYS + STEP + HASH for every session, compared to
+ *               the same frames run in this process to get the overhead per
+ *               request.
+ *   frame       FRAME for every session in one batch.
+ */
+
+#define LOAD_DEFAULT_SESSIONS  256
+#define LOAD_DEFAULT_FRAMES    1
+#define LOAD_DEFAULT_ROUNDS    1000
+#define LOAD_LATENCY_ROUNDS    1000        /* single request batches */
+#define LOAD_RNG_SEED          0x2545F491
+
+
+typedef struct client {
+    int fd;
+    uint8_t* batch;                         /* batch being built, header included */
+    size_t len, size;
+    uint32_t count;
+
+    uint8_t* replies;                       /* last reply batch, header excluded */
+    size_t replies_size;
+    size_t next_reply;
+} client_t;
+
+typedef struct load {
+    const char* socket_path;
+    int nb_sessions;
+    int frames;
+    int rounds;
+} load_t;
+
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"socket", required_argument, 0, 's'},
+    {"count", required_argument, 0, 'n'},
+    {"frames", required_argument, 0, 'f'},
+    {"rounds", required_argument, 0, 'r'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip8-load [OPTIONS] <rom_path>...\n\n");
+    printf("Options:\n");
+    printf("  -s, --socket <path>      chip-8d socket (default %s).\n", SERVER_DEFAULT_PATH);
+    printf("  -n, --count <amount>     Sessions (default %d).\n", LOAD_DEFAULT_SESSIONS);
+    printf("  -f, --frames <amount>    Frames per STEP (default %d).\n", LOAD_DEFAULT_FRAMES);
+    printf("  -r, --rounds <amount>    Step rounds (default %d).\n", LOAD_DEFAULT_ROUNDS);
+    printf("  -h, --help               Display this help message and exit.\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static double priv_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+}
+
+static uint16_t priv_random_keys(uint32_t* seed) {                             /* one random key or none, xorshift32 */
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+
+    return (*seed & 0x10) ? 1 << (*seed & 0xF) : 0;
+}
+
+static int priv_compare(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+static double priv_percentile(double* samples, int count, int percent) {     /* sorts samples */
+    qsort(samples, count, sizeof(double), priv_compare);
+    return samples[(count - 1) * percent / 100];
+}
+
+static uint8_t* priv_read_file(const char* path, size_t* len) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* data;
+    long size;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0) {
+        printf("[ERROR] Cant read rom %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    rewind(file);
+
+    data = malloc(size);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        printf("[ERROR] Cant read rom %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    *len = size;
+
+    return data;
+}
+
+static void priv_connect(client_t* client, const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    memset(client, 0, sizeof(client_t));
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        printf("[ERROR] Cant connect to %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void priv_disconnect(client_t* client) {
+    close(client->fd);
+    free(client->batch);
+    free(client->replies);
+}
+
+static void priv_reserve(uint8_t** data, size_t* size, size_t needed) {
+    if (needed <= *size) return;
+
+    *size = needed * 2;
+    *data = realloc(*data, *size);
+    if (*data == NULL) {
+        printf("[ERROR] Cant allocate client buffer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void priv_begin(client_t* client) {
+    priv_reserve(&client->batch, &client->size, sizeof(server_batch_t));
+    client->len = sizeof(server_batch_t);
+    client->count = 0;
+}
+
+static void priv_add(client_t* client, server_op_t op, uint8_t flags, uint32_t session, uint32_t arg, const void* payload, uint32_t len) {
+    server_request_t request = { .op = op, .flags = flags, .session = session, .arg = arg, .len = len };
+
+    priv_reserve(&client->batch, &client->size, client->len + sizeof(request) + len);
+    memcpy(client->batch + client->len, &request, sizeof(request));
+    client->len += sizeof(request);
+    if (len > 0) {
+        memcpy(client->batch + client->len, payload, len);
+        client->len += len;
+    }
+    client->count++;
+}
+
+static void priv_io(int fd, uint8_t* data, size_t len, int sending) {          /* whole buffer or exit */
+    ssize_t done;
+
+    while (len > 0) {
+        done = sending ? send(fd, data, len, MSG_NOSIGNAL) : recv(fd, data, len, 0);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) {
+            printf("[ERROR] Connection to chip-8d lost\n");
+            exit(EXIT_FAILURE);
+        }
+        data += done;
+        len -= done;
+    }
+}
+
+static void priv_round_trip(client_t* client) {                                 /* sends the batch, waits for its replies */
+    server_batch_t batch = { .size = client->len - sizeof(server_batch_t), .count = client->count };
+
+    memcpy(client->batch, &batch, sizeof(batch));
+    priv_io(client->fd, client->batch, client->len, TRUE);
+
+    priv_io(client->fd, (uint8_t*)&batch, sizeof(batch), FALSE);
+    priv_reserve(&client->replies, &client->replies_size, batch.size);
+    priv_io(client->fd, client->replies, batch.size, FALSE);
+    client->next_reply = 0;
+
+    if (batch.count != client->count) {
+        printf("[ERROR] %u replies to %u requests\n", batch.count, client->count);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static server_reply_t priv_next_reply(client_t* client) {                      /* skips the payload, exits on an error status */
+    server_reply_t reply;
+
+    memcpy(&reply, client->replies + client->next_reply, sizeof(reply));
+    client->next_reply += sizeof(reply) + reply.len;
+
+    if (reply.status != SERVER_OK) {
+        printf("[ERROR] Request %u failed with status %u\n", reply.op, reply.status);
+        exit(EXIT_FAILURE);
+    }
+
+    return reply;
+}
+
+static double priv_timed_round_trip(client_t* client) {                        /* seconds */
+    double start = priv_now();
+
+    priv_round_trip(client);
+    return priv_now() - start;
+}
+
+static double priv_in_process(const load_t* load, const uint8_t* rom_data, size_t rom_len, uint16_t* keys) {     /* the step phase without a server, seconds */
+    int n = load->nb_sessions, frames = load->frames;
+    uint32_t key_seed = LOAD_RNG_SEED;
+    chip8_t** instances;
+    double start;
+    rom_t* rom;
+
+    instances = malloc(n * sizeof(chip8_t*));
+    if (instances == NULL) {
+        printf("[ERROR] Cant allocate instances\n");
+        exit(EXIT_FAILURE);
+    }
+    rom = rom_create(rom_data, rom_len);
+
+    start = priv_now();
+    for (int i = 0; i < n; i++) {
+        instances[i] = chip8_create(rom);
+    }
+    for (int round = 0; round < load->rounds; round++) {
+        for (int i = 0; i < n * frames; i++) {
+            keys[i] = priv_random_keys(&key_seed);
+        }
+        for (int i = 0; i < n; i++) {
+            for (int f = 0; f < frames; f++) {
+                chip8_run_frame(instances[i], keys[i * frames + f]);
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        chip8_destroy(instances[i]);
+    }
+    start = priv_now() - start;
+
+    rom_release(rom);
+    free(instances);
+
+    return start;
+}
+
+static void priv_run(const load_t* load, const char* rom_path) {
+    int n = load->nb_sessions, frames = load->frames;
+    uint32_t key_seed = LOAD_RNG_SEED;
+    double create, single_hash, batch_hash, stepping = 0, in_process, fetch;
+    double* samples;
+    uint32_t* sessions;
+    uint16_t* keys;
+    uint8_t* rom_data;
+    size_t rom_len;
+    client_t client;
+
+    samples = malloc((load->rounds > LOAD_LATENCY_ROUNDS ? load->rounds : LOAD_LATENCY_ROUNDS) * sizeof(double));
+    sessions = malloc(n * sizeof(uint32_t));
+    keys = malloc((size_t)n * frames * sizeof(uint16_t));
+    if (samples == NULL || sessions == NULL || keys == NULL) {
+        printf("[ERROR] Cant allocate load buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    rom_data = priv_read_file(rom_path, &rom_len);
+    priv_connect(&client, load->socket_path);
+
+    priv_begin(&client);                                                        /* create, the first one loads the rom */
+    for (int i = 0; i < n; i++) {
+        priv_add(&client, SERVER_OP_CREATE, VARIANT_CHIP8, 0, 0, rom_data, rom_len);
+    }
+    create = priv_timed_round_trip(&client);
+    for (int i = 0; i < n; i++) {
+        sessions[i] = priv_next_reply(&client).session;
+    }
+
+    for (int round = 0; round < LOAD_LATENCY_ROUNDS; round++) {
+        priv_begin(&client);
+        priv_add(&client, SERVER_OP_CREATE, VARIANT_CHIP8, 0, 0, rom_data, rom_len);
+        priv_add(&client, SERVER_OP_DESTROY, 0, n + 1, 0, NULL, 0);             /* free slots are reused, it is always n + 1 */
+        samples[round] = priv_timed_round_trip(&client);
+    }
+    printf("%s\n", rom_path);
+    printf("sessions:           %d, %d frames per step\n", n, frames);
+    printf("create:             %.2f us / session in one batch, %.1f us round trip alone (p50)\n", create * 1.0e6 / n, priv_percentile(samples, LOAD_LATENCY_ROUNDS, 50) * 1.0e6);
+
+    for (int round = 0; round < LOAD_LATENCY_ROUNDS; round++) {                 /* hash, no emulation */
+        priv_begin(&client);
+        priv_add(&client, SERVER_OP_HASH, 0, sessions[0], 0, NULL, 0);
+        samples[round] = priv_timed_round_trip(&client);
+    }
+    single_hash = priv_percentile(samples, LOAD_LATENCY_ROUNDS, 50);
+    printf("batch round trip:   %.1f us p50, %.1f us p99\n", single_hash * 1.0e6, priv_percentile(samples, LOAD_LATENCY_ROUNDS, 99) * 1.0e6);
+
+    priv_begin(&client);
+    for (int i = 0; i < n; i++) {
+        priv_add(&client, SERVER_OP_HASH, 0, sessions[i], 0, NULL, 0);
+    }
+    for (int round = 0; round < LOAD_LATENCY_ROUNDS; round++) {
+        samples[round] = priv_timed_round_trip(&client);
+    }
+    batch_hash = priv_percentile(samples, LOAD_LATENCY_ROUNDS, 50);
+    printf("request in batch:   %.0f ns (HASH, batches of %d)\n", (batch_hash - single_hash) * 1.0e9 / (n > 1 ? n - 1 : 1), n);
+
+    for (int round = 0; round < load->rounds; round++) {                        /* step */
+        for (int i = 0; i < n * frames; i++) {
+            keys[i] = priv_random_keys(&key_seed);
+        }
+        priv_begin(&client);
+        for (int i = 0; i < n; i++) {
+            priv_add(&client, SERVER_OP_KEYS, 0, sessions[i], 0, keys + i * frames, frames * sizeof(uint16_t));
+            priv_add(&client, SERVER_OP_STEP, 0, sessions[i], frames, NULL, 0);
+            priv_add(&client, SERVER_OP_HASH, 0, sessions[i], 0, NULL, 0);
+        }
+        samples[round] = priv_timed_round_trip(&client);
+        stepping += samples[round];
+    }
+
+    in_process = priv_in_process(load, rom_data, rom_len, keys);
+
+    printf("step round trip:    %.1f us p50, %.1f us p99 (%d requests)\n", priv_percentile(samples, load->rounds, 50) * 1.0e6, priv_percentile(samples, load->rounds, 99) * 1.0e6, 3 * n);
+    printf("step:               %.0f frames / ms, %.0f frames / ms in process\n", (double)n * frames * load->rounds / stepping / 1000.0, (double)n * frames * load->rounds / in_process / 1000.0);
+    printf("step overhead:      %.0f ns / request\n", (stepping - in_process) * 1.0e9 / (3.0 * n * load->rounds));
+
+    priv_begin(&client);                                                        /* frame */
+    for (int i = 0; i < n; i++) {
+        priv_add(&client, SERVER_OP_FRAME, 0, sessions[i], 0, NULL, 0);
+    }
+    fetch = priv_timed_round_trip(&client);
+    printf("frame:              %.0f ns / session\n", fetch * 1.0e9 / n);
+
+    priv_begin(&client);
+    for (int i = 0; i < n; i++) {
+        priv_add(&client, SERVER_OP_DESTROY, 0, sessions[i], 0, NULL, 0);
+    }
+    priv_round_trip(&client);
+
+    priv_disconnect(&client);
+    free(rom_data);
+    free(keys);
+    free(sessions);
+    free(samples);
+}
+
+static int priv_to_int(const char* input) {
+    char* end;
+    long res = strtol(input, &end, 10);
+
+    if (*end != '\0' || res <= 0) {
+        printf("%serror:%s not a number.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    load_t load = { .socket_path = SERVER_DEFAULT_PATH, .nb_sessions = LOAD_DEFAULT_SESSIONS, .frames = LOAD_DEFAULT_FRAMES, .rounds = LOAD_DEFAULT_ROUNDS };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "hs:n:f:r:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': load.socket_path = optarg; break;
+            case 'n': load.nb_sessions = priv_to_int(optarg); break;
+            case 'f': load.frames = priv_to_int(optarg); break;
+            case 'r': load.rounds = priv_to_int(optarg); break;
+            default: priv_help(); break;
+        }
+    }
+    if (optind >= argc) {
+        priv_help();
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (i > optind) printf("\n");
+        priv_run(&load, argv[i]);
+    }
+
+    exit(EXIT_SUCCESS);
+}
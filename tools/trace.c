@@ -0,0 +1,250 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+
+/*
+ * Decoder for the binary traces written by `chip-8 --trace`, see trace.h
+ * for the format. Prints the records in a PC range, and / or a summary.
+ */
+
+#define TOP_PCS  10
+
+
+typedef struct decoder {
+    FILE* file;
+    uint16_t start, end;                    /* PC filter, inclusive */
+    int summary_only;
+
+    uint64_t nb_instructions, nb_shown, nb_frames, nb_key_changes;
+    uint64_t by_group[16];                  /* by first opcode nibble */
+    uint32_t by_pc[MEMORY_MAX_SIZE];        /* 64 KB for XO-CHIP traces */
+} decoder_t;
+
+
+static const struct option long_options [] = {
+    {"help", no_argument, 0, 'h'},
+    {"start", required_argument, 0, 's'},
+    {"end", required_argument, 0, 'e'},
+    {"summary", no_argument, 0, 'S'},
+    {0, 0, 0, 0}
+};
+
+
+/******************************************************
+ *                 Private functions                  *
+ ******************************************************/
+
+static void priv_help() {
+    printf("Usage: ./chip8-trace [OPTIONS] <trace_file>\n\n");
+    printf("Options:\n");
+    printf("  -s, --start <addr>       Only show instructions at or after this hex PC.\n");
+    printf("  -e, --end <addr>         Only show instructions at or before this hex PC.\n");
+    printf("  -S, --summary            Only print the summary.\n");
+    printf("  -h, --help               Display this help message and exit.\n");
+
+    exit(EXIT_SUCCESS);
+}
+
+static void priv_truncated() {
+    printf("[ERROR] Truncated trace\n");
+    exit(EXIT_FAILURE);
+}
+
+static uint8_t priv_byte(decoder_t* decoder) {
+    int c = getc(decoder->file);
+
+    if (c == EOF) {
+        priv_truncated();
+    }
+    return c;
+}
+
+static uint32_t priv_varint(decoder_t* decoder) {
+    uint32_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = priv_byte(decoder);
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80 && shift < 35);
+
+    return value;
+}
+
+static void priv_instruction(decoder_t* decoder, uint8_t tag, uint16_t* expected_pc) {
+    char line[256];
+    int len = 0, show;
+    uint16_t opcode, pc;
+
+    opcode = priv_byte(decoder) << 8;
+    opcode |= priv_byte(decoder);
+
+    pc = (tag & TRACE_PC) ? priv_varint(decoder) : *expected_pc;
+    *expected_pc = trace_next_pc(pc, opcode);
+    show = !decoder->summary_only && pc >= decoder->start && pc <= decoder->end;
+
+    if (tag & TRACE_REGS) {
+        uint16_t mask = priv_varint(decoder);
+
+        for (int i = 0; i < NB_REGISTER; i++) {
+            if (BIT_CHECK(mask, i)) {
+                len += snprintf(line + len, sizeof(line) - len, " V%X=%02X", i, priv_byte(decoder));
+            }
+        }
+    }
+    if (tag & TRACE_I) {
+        len += snprintf(line + len, sizeof(line) - len, " I=%03X", priv_varint(decoder));
+    }
+    if (tag & TRACE_MEM) {
+        uint32_t addr = priv_varint(decoder);
+        uint8_t nb = priv_byte(decoder);
+
+        len += snprintf(line + len, sizeof(line) - len, " [%03X]=", addr);
+        for (uint8_t i = 0; i < nb; i++) {
+            len += snprintf(line + len, sizeof(line) - len, "%02X", priv_byte(decoder));
+        }
+    }
+    if (tag & TRACE_STACK) {
+        uint8_t sp = priv_byte(decoder);
+
+        len += snprintf(line + len, sizeof(line) - len, " SP=%X", sp);
+        if ((opcode & 0xF000) == 0x2000) {
+            len += snprintf(line + len, sizeof(line) - len, " ret=%03X", priv_varint(decoder));
+        }
+    }
+    if (tag & TRACE_TIMERS) {
+        uint8_t dt = priv_byte(decoder);
+        len += snprintf(line + len, sizeof(line) - len, " DT=%02X ST=%02X", dt, priv_byte(decoder));
+    }
+    line[len] = '\0';
+
+    decoder->nb_instructions++;
+    decoder->by_group[opcode >> 12]++;
+    decoder->by_pc[pc]++;
+
+    if (show) {
+        decoder->nb_shown++;
+        printf("%6" PRIu64 "  %03X: %04X%s\n", decoder->nb_frames, pc, opcode, line);
+    }
+}
+
+static void priv_decode(decoder_t* decoder) {
+    uint16_t pc = ROM_START_ADR;
+    char magic[4];
+    int tag;
+
+    if (fread(magic, 1, 4, decoder->file) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0) {
+        printf("[ERROR] Not a chip-8 trace\n");
+        exit(EXIT_FAILURE);
+    }
+    if (priv_byte(decoder) != TRACE_VERSION) {
+        printf("[ERROR] Unsupported trace version\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while ((tag = getc(decoder->file)) != EOF) {
+        if (tag == TRACE_FRAME) {
+            uint8_t dt = priv_byte(decoder);
+            uint8_t st = priv_byte(decoder);
+
+            decoder->nb_frames++;
+            if (!decoder->summary_only && decoder->start == 0 && decoder->end == 0xFFFF) {
+                printf("%6" PRIu64 "  frame DT=%02X ST=%02X\n", decoder->nb_frames, dt, st);
+            }
+        } else if (tag == TRACE_KEYS) {
+            uint32_t keys = priv_varint(decoder);
+
+            decoder->nb_key_changes++;
+            if (!decoder->summary_only) {
+                printf("%6" PRIu64 "  keys " BYTE_TO_BINARY_PATTERN " " BYTE_TO_BINARY_PATTERN "\n",
+                       decoder->nb_frames, BYTE_TO_BINARY(keys >> 8), BYTE_TO_BINARY(keys));
+            }
+        } else if ((tag & 0x80) == 0) {
+            priv_instruction(decoder, tag, &pc);
+        } else {
+            printf("[ERROR] Unknown record tag 0x%02X\n", tag);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void priv_summary(decoder_t* decoder) {
+    printf("\ninstructions:  %" PRIu64 " (%" PRIu64 " in range)\n", decoder->nb_instructions, decoder->nb_shown);
+    printf("frames:        %" PRIu64 "\n", decoder->nb_frames);
+    printf("key changes:   %" PRIu64 "\n", decoder->nb_key_changes);
+
+    printf("\nby opcode group:\n");
+    for (int i = 0; i < 16; i++) {
+        if (decoder->by_group[i] > 0) {
+            printf("  %Xnnn  %10" PRIu64 "  %5.1f%%\n", i, decoder->by_group[i], 100.0 * decoder->by_group[i] / decoder->nb_instructions);
+        }
+    }
+
+    printf("\nhottest PCs:\n");
+    for (int n = 0; n < TOP_PCS; n++) {
+        int best = 0;
+
+        for (int i = 1; i < MEMORY_MAX_SIZE; i++) {
+            if (decoder->by_pc[i] > decoder->by_pc[best]) {
+                best = i;
+            }
+        }
+        if (decoder->by_pc[best] == 0) break;
+
+        printf("  %03X  %10u\n", best, decoder->by_pc[best]);
+        decoder->by_pc[best] = 0;
+    }
+}
+
+static uint16_t priv_to_addr(const char* input) {
+    char* end;
+    long res = strtol(input, &end, 16);
+
+    if (*end != '\0' || res < 0 || res > 0xFFFF) {
+        printf("%serror:%s not an address.\n", "\033[1;31m", "\033[0m");
+        exit(EXIT_FAILURE);
+    }
+
+    return res;
+}
+
+
+/******************************************************
+ *                 Main                               *
+ ******************************************************/
+
+int main(int argc, char* argv []) {
+    static decoder_t decoder = { .start = 0, .end = 0xFFFF };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "hs:e:S", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': decoder.start = priv_to_addr(optarg); break;
+            case 'e': decoder.end = priv_to_addr(optarg); break;
+            case 'S': decoder.summary_only = TRUE; break;
+            default: priv_help(); break;
+        }
+    }
+    if (optind != argc - 1) {
+        priv_help();
+    }
+
+    decoder.file = fopen(argv[optind], "rb");
+    if (decoder.file == NULL) {
+        printf("[ERROR] Cant open trace file: %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    priv_decode(&decoder);
+    priv_summary(&decoder);
+    fclose(decoder.file);
+
+    exit(EXIT_SUCCESS);
+}